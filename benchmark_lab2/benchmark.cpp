@@ -1,18 +1,27 @@
 #include "benchmark.h"
 
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <vector>
 #include <iostream>
+#include <omp.h>
 
 #include "simulation/naive_sequential_simulation.h"
 
 
 #include "simulation/naive_parallel_simulation.h"
+#include "simulation/naive_tiled_simulation.h"
 #include "simulation/barnes_hut_simulation.h"
 #include "simulation/barnes_hut_simulation_with_collisions.h"
+#include "simulation/fast_multipole_simulation.h"
+#include "simulation/integrator.h"
+#include "simulation/block_timestep_simulation.h"
+#include "physics/gravitation.h"
 
 #include "input_generator/input_generator.h"
+#include "quadtree/morton.h"
 
 
 static void benchmark_get_bounding_box_sequential(benchmark::State& state){
@@ -87,6 +96,25 @@ static void benchmark_naive_parallel(benchmark::State& state) {
 }
 
 
+static void benchmark_naive_tiled(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		NaiveTiledSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+	}
+}
+
 static void benchmark_barnes_hut(benchmark::State& state) {
 	const auto number_bodies = state.range(0);
 	const auto number_epochs = state.range(1);
@@ -107,6 +135,410 @@ static void benchmark_barnes_hut(benchmark::State& state) {
 	}	
 }
 
+static void benchmark_naive_parallel_soa(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		UniverseSoA uni_soa(uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		NaiveParallelSimulation::simulate_epochs(plotter, uni_soa, number_epochs, false, 1);
+	}
+}
+
+static void benchmark_barnes_hut_soa(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		UniverseSoA uni_soa(uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		BarnesHutSimulation::simulate_epochs(plotter, uni_soa, number_epochs, false, 1);
+	}
+}
+
+static void benchmark_naive_force_kernel(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto kernel_type = static_cast<NaiveForceKernelType>(state.range(1));
+	if(!naive_force_kernel_available(kernel_type)){
+		state.SkipWithError("force kernel not supported on this cpu");
+		return;
+	}
+	state.SetLabel(get_naive_force_kernel_name(kernel_type));
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	UniverseSoA uni_soa(uni);
+	NaiveParallelSimulation::force_kernel = kernel_type;
+
+	for (auto _ : state) {
+		NaiveParallelSimulation::calculate_forces_simd(uni_soa);
+		benchmark::DoNotOptimize(uni_soa.forces.x.data());
+	}
+	NaiveParallelSimulation::force_kernel = NaiveForceKernelType::automatic;
+}
+
+// sqrt and division against the fast inverse square root (bodies, kernel, fast). kernel: 0 -> naive parallel,
+// 1 -> naive structure-of-arrays, 2 -> vectorized naive kernel, 3 -> Barnes-Hut bucket traversal.
+// reports the largest force error relative to sqrt and division as a counter
+static void benchmark_force_law(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto kernel = state.range(1);
+	const bool fast = state.range(2) != 0;
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	UniverseSoA uni_soa(uni);
+	Quadtree qt(uni, uni.get_bounding_box(), 3, BarnesHutSimulation::bucket_size);
+	qt.calculate_moments();
+	BarnesHutSimulation::force_engine = 2;
+	auto calculate_forces = [&](){
+		switch (kernel) {
+			case 0: NaiveParallelSimulation::calculate_forces(uni); break;
+			case 1: NaiveParallelSimulation::calculate_forces(uni_soa); break;
+			case 2: NaiveParallelSimulation::calculate_forces_simd(uni_soa); break;
+			default: BarnesHutSimulation::calculate_forces(uni, qt); break;
+		}
+	};
+	auto get_force = [&](int i){
+		return kernel == 1 || kernel == 2 ? Vector2d<double>(uni_soa.forces.x[i], uni_soa.forces.y[i]) : uni.forces[i];
+	};
+
+	calculate_forces();
+	std::vector<Vector2d<double>> reference_forces(number_bodies);
+	for(int i = 0; i < number_bodies; i++){
+		reference_forces[i] = get_force(i);
+	}
+
+	Gravitation::fast_inverse_sqrt = fast;
+	for (auto _ : state) {
+		calculate_forces();
+	}
+	Gravitation::fast_inverse_sqrt = false;
+	BarnesHutSimulation::force_engine = 0;
+
+	double max_error = 0.0;
+	for(int i = 0; i < number_bodies; i++){
+		max_error = std::max(max_error, (get_force(i) - reference_forces[i]).norm() / reference_forces[i].norm());
+	}
+	state.counters["max_relative_error"] = max_error;
+}
+
+static void benchmark_barnes_hut_construct_mode(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	BarnesHutSimulation::construct_mode = state.range(2);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		BarnesHutSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+	}
+	BarnesHutSimulation::construct_mode = 2;
+}
+
+static void benchmark_barnes_hut_force_engine(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	BarnesHutSimulation::force_engine = static_cast<std::int8_t>(state.range(2));
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		BarnesHutSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+	}
+	BarnesHutSimulation::force_engine = 0;
+}
+
+// force law: sqrt and division (0) against the fast inverse square root (1)
+BENCHMARK(benchmark_force_law)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{20000}, {0, 1, 2}, {0, 1}});
+BENCHMARK(benchmark_force_law)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{100000}, {3}, {0, 1}});
+
+// tree maintenance of one epoch: full rebuild against incremental refit of the kept quadtree (bodies, epochs, incremental)
+static void benchmark_barnes_hut_incremental(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	const bool incremental = state.range(2) != 0;
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	std::unique_ptr<Quadtree> quadtree;
+	BarnesHutSimulation::update_quadtree(uni, quadtree);
+	BarnesHutSimulation::tree_refits = 0;
+	BarnesHutSimulation::tree_rebuilds = 0;
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// move the bodies, no forces are calculated so they drift with their initial velocities
+		for(int i = 0; i < number_epochs; i++){
+			NaiveParallelSimulation::calculate_velocities(uni);
+			NaiveParallelSimulation::calculate_positions(uni);
+		}
+		if(!incremental){
+			quadtree.reset();
+		}
+		state.ResumeTiming();
+		BarnesHutSimulation::update_quadtree(uni, quadtree);
+	}
+	state.counters["refits"] = static_cast<double>(BarnesHutSimulation::tree_refits);
+	state.counters["rebuilds"] = static_cast<double>(BarnesHutSimulation::tree_rebuilds);
+}
+
+// 20 simulated years of the earth orbit (integrator, time step in days). reports the largest relative energy error
+// and the force evaluations, the higher order integrators reach the same error with larger steps and fewer evaluations
+static void benchmark_integrator(benchmark::State& state) {
+	const double time_step = static_cast<double>(state.range(1)) * 86400;
+	const auto steps = static_cast<std::int64_t>(std::round(20 * 12 * epoch_in_seconds / time_step));
+	Integrator::integrator = static_cast<IntegratorType>(state.range(0));
+	Integrator::time_step = time_step;
+
+	Universe initial_uni;
+	InputGenerator::create_earth_orbit(initial_uni);
+	const double initial_energy = Integrator::total_energy(initial_uni);
+	double energy_error = 0;
+	for (auto _ : state) {
+		Universe uni = initial_uni;
+		Integrator::force_evaluations = 0;
+		energy_error = 0;
+		for (std::int64_t i = 0; i < steps; i++) {
+			Integrator::step(uni, [](Universe& u) { NaiveParallelSimulation::calculate_forces(u); });
+			energy_error = std::max(energy_error, std::abs((Integrator::total_energy(uni) - initial_energy) / initial_energy));
+		}
+	}
+	state.counters["energy_error"] = energy_error;
+	state.counters["force_evaluations"] = static_cast<double>(Integrator::force_evaluations);
+	Integrator::integrator = IntegratorType::euler;
+	Integrator::time_step = epoch_in_seconds;
+}
+
+// separate passes against the fused epoch pipeline (bodies, epochs, simulation, fused),
+// simulation: 0 -> naive parallel, 1 -> Barnes-Hut bucket traversal (force engine 2), 2 -> Barnes-Hut with collisions
+static void benchmark_fused_epoch(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	const auto simulation = state.range(2);
+	NaiveParallelSimulation::fused_epoch = state.range(3) != 0;
+	BarnesHutSimulation::fused_epoch = state.range(3) != 0;
+	BarnesHutSimulation::force_engine = simulation == 1 ? 2 : 0;
+
+	Universe initial_uni;
+	InputGenerator::create_random_universe(number_bodies, initial_uni);
+	BoundingBox bb(-5, 5, -5, 5);
+	auto tmp_path = std::filesystem::path{"dummy_plot"};
+	Plotter plotter(bb, tmp_path, 400, 400);
+	for (auto _ : state) {
+		state.PauseTiming();
+		Universe uni = initial_uni;
+		state.ResumeTiming();
+		if (simulation == 0) {
+			NaiveParallelSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+		} else if (simulation == 1) {
+			BarnesHutSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+		} else {
+			BarnesHutSimulationWithCollisions::simulate_epochs(plotter, uni, number_epochs, false, 1);
+		}
+	}
+	NaiveParallelSimulation::fused_epoch = false;
+	BarnesHutSimulation::fused_epoch = false;
+	BarnesHutSimulation::force_engine = 0;
+}
+
+// one epoch of a universe with two supermassive black holes (bodies, block): 1 -> individual time steps with up to 8 levels,
+// 0 -> global leapfrog with the finest of these steps. body_force_evaluations counts the forces computed for single bodies
+static void benchmark_block_timesteps(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const bool block = state.range(1) != 0;
+	BlockTimestepSimulation::max_level = 8;
+
+	Universe initial_uni;
+	InputGenerator::create_random_universe_with_supermassive_blackholes(number_bodies, initial_uni, 2);
+	BoundingBox bb(-5, 5, -5, 5);
+	auto tmp_path = std::filesystem::path{"dummy_plot"};
+	Plotter plotter(bb, tmp_path, 400, 400);
+	std::uint64_t evaluations = 0;
+	for (auto _ : state) {
+		state.PauseTiming();
+		Universe uni = initial_uni;
+		std::unique_ptr<Quadtree> quadtree;
+		BlockTimestepSimulation::body_force_evaluations = 0;
+		Integrator::force_evaluations = 0;
+		state.ResumeTiming();
+		if (block) {
+			BlockTimestepSimulation::simulate_epoch(plotter, uni, quadtree, false, 1);
+			evaluations = BlockTimestepSimulation::body_force_evaluations;
+		} else {
+			Integrator::integrator = IntegratorType::leapfrog;
+			Integrator::time_step = epoch_in_seconds / (1 << BlockTimestepSimulation::max_level);
+			for (std::int32_t i = 0; i < (1 << BlockTimestepSimulation::max_level); i++) {
+				Integrator::step(uni, [&](Universe& u) {
+					BarnesHutSimulation::update_quadtree(u, quadtree);
+					BarnesHutSimulation::calculate_forces_stack(u, *quadtree, BarnesHutSimulation::threshold_theta);
+				});
+			}
+			Integrator::integrator = IntegratorType::euler;
+			Integrator::time_step = epoch_in_seconds;
+			evaluations = Integrator::force_evaluations * uni.num_bodies;
+		}
+	}
+	state.counters["body_force_evaluations"] = static_cast<double>(evaluations);
+}
+
+// full epochs with the bodies sorted along the Morton curve every reorder_interval epochs (bodies, epochs, interval, 0 -> never)
+static void benchmark_barnes_hut_reorder(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	BarnesHutSimulation::reorder_interval = static_cast<std::uint32_t>(state.range(2));
+
+	Universe initial_uni;
+	InputGenerator::create_random_universe(number_bodies, initial_uni);
+	BoundingBox bb(-5, 5, -5, 5);
+	auto tmp_path = std::filesystem::path{"dummy_plot"};
+	Plotter plotter(bb, tmp_path, 400, 400);
+	for (auto _ : state) {
+		state.PauseTiming();
+		Universe uni = initial_uni;
+		state.ResumeTiming();
+		BarnesHutSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+	}
+	BarnesHutSimulation::reorder_interval = 0;
+}
+
+// force calculation alone on the generated (random) body order against the Morton order (bodies, morton)
+static void benchmark_barnes_hut_forces_order(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	if (state.range(1) != 0) {
+		morton_reorder(uni);
+	}
+	Quadtree quadtree(uni, uni.get_bounding_box(), 2);
+	quadtree.calculate_moments();
+	for (auto _ : state) {
+		BarnesHutSimulation::calculate_forces(uni, quadtree);
+	}
+}
+
+// theta is passed in hundredths, reports the force error relative to the naive kernel as counters
+static void benchmark_barnes_hut_theta(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	BarnesHutSimulation::threshold_theta = state.range(1) / 100.0;
+	BarnesHutSimulation::multipole_order = static_cast<std::int8_t>(state.range(2));
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	Universe reference_uni = uni;
+	NaiveParallelSimulation::calculate_forces(reference_uni);
+
+	for (auto _ : state) {
+		Quadtree qt(uni, uni.get_bounding_box(), BarnesHutSimulation::construct_mode);
+		qt.calculate_center_of_mass();
+		qt.calculate_cumulative_masses();
+		BarnesHutSimulation::calculate_forces(uni, qt);
+	}
+
+	double sum_squared_error = 0.0;
+	double max_error = 0.0;
+	for(int i = 0; i < uni.num_bodies; i++){
+		double error = (uni.forces[i] - reference_uni.forces[i]).norm() / reference_uni.forces[i].norm();
+		sum_squared_error += error * error;
+		max_error = std::max(max_error, error);
+	}
+	state.counters["rms_relative_error"] = std::sqrt(sum_squared_error / uni.num_bodies);
+	state.counters["max_relative_error"] = max_error;
+
+	BarnesHutSimulation::threshold_theta = 0.2;
+	BarnesHutSimulation::multipole_order = 0;
+}
+
+// forces of the bucket traversal in double (force engine 2) and mixed precision (force engine 3) on the same tree (bodies, engine),
+// reports the error relative to the double traversal as counters
+static void benchmark_barnes_hut_mixed_precision(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto force_engine = static_cast<std::int8_t>(state.range(1));
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	Quadtree qt(uni, uni.get_bounding_box(), 3, BarnesHutSimulation::bucket_size);
+	qt.calculate_moments();
+	Universe reference_uni = uni;
+	BarnesHutSimulation::force_engine = 2;
+	BarnesHutSimulation::calculate_forces(reference_uni, qt);
+
+	BarnesHutSimulation::force_engine = force_engine;
+	for (auto _ : state) {
+		BarnesHutSimulation::calculate_forces(uni, qt);
+	}
+	BarnesHutSimulation::force_engine = 0;
+
+	double sum_squared_error = 0.0;
+	double max_error = 0.0;
+	for(int i = 0; i < uni.num_bodies; i++){
+		double error = (uni.forces[i] - reference_uni.forces[i]).norm() / reference_uni.forces[i].norm();
+		sum_squared_error += error * error;
+		max_error = std::max(max_error, error);
+	}
+	state.counters["rms_relative_error"] = std::sqrt(sum_squared_error / uni.num_bodies);
+	state.counters["max_relative_error"] = max_error;
+}
+
+static void benchmark_fast_multipole(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto number_epochs = state.range(1);
+	FastMultipoleSimulation::expansion_order = state.range(2);
+	FastMultipoleSimulation::max_leaf_size = state.range(3);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		// initialize universe
+		Universe uni;
+		InputGenerator::create_random_universe(number_bodies, uni);
+		// create dummy plotter
+		BoundingBox bb(-5, 5, -5, 5);
+		auto tmp_path = std::filesystem::path{"dummy_plot"};
+		Plotter plotter(bb, tmp_path, 400, 400);
+
+		state.ResumeTiming();
+		FastMultipoleSimulation::simulate_epochs(plotter, uni, number_epochs, false, 1);
+	}
+	FastMultipoleSimulation::expansion_order = 4;
+	FastMultipoleSimulation::max_leaf_size = 32;
+}
+
 static void benchmark_barnes_hut_with_collisions(benchmark::State& state) {
 	const auto number_bodies = state.range(0);
 
@@ -142,6 +574,24 @@ static void benchmark_construct_quadtree(benchmark::State& state) {
 	}	
 }
 
+// construction with a fixed number of threads (bodies, construct mode, threads, task cutoff of mode 5, 0 -> adaptive)
+static void benchmark_construct_quadtree_threads(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const std::int8_t construct_mode = state.range(1);
+	const int previous_threads = omp_get_max_threads();
+	omp_set_num_threads(static_cast<int>(state.range(2)));
+	Quadtree::construct_task_cutoff = static_cast<std::int32_t>(state.range(3));
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	BoundingBox bb = uni.get_bounding_box();
+	for (auto _ : state) {
+		Quadtree(uni, bb, construct_mode);
+	}
+	Quadtree::construct_task_cutoff = 0;
+	omp_set_num_threads(previous_threads);
+}
+
 static void benchmark_calculate_cumulative_masses(benchmark::State& state) {
 	const auto number_bodies = state.range(0);
 
@@ -158,6 +608,30 @@ static void benchmark_calculate_cumulative_masses(benchmark::State& state) {
 	}	
 }
 
+// mass and center of mass (bodies, threads, 0 -> two serial recursions, 1 -> one parallel pass)
+static void benchmark_calculate_moments(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const int previous_threads = omp_get_max_threads();
+	omp_set_num_threads(static_cast<int>(state.range(1)));
+	const bool parallel = state.range(2) != 0;
+
+	Universe uni;
+	InputGenerator::create_random_universe(number_bodies, uni);
+	BoundingBox bb = uni.get_bounding_box();
+	for (auto _ : state) {
+		state.PauseTiming();
+		Quadtree qt = Quadtree(uni, bb, 5);
+		state.ResumeTiming();
+		if (parallel) {
+			qt.calculate_moments();
+		} else {
+			qt.calculate_center_of_mass();
+			qt.calculate_cumulative_masses();
+		}
+	}
+	omp_set_num_threads(previous_threads);
+}
+
 static void benchmark_find_collisions(benchmark::State& state) {
 	const auto number_bodies = state.range(0);
 
@@ -173,6 +647,48 @@ static void benchmark_find_collisions(benchmark::State& state) {
 	}	
 }
 
+// collision engines on the random universe (bodies, engine: 0 -> all pairs, 1 -> grid, 2 -> quadtree queries).
+// the quadtree is not timed, in the simulation it is the refitted Barnes-Hut tree
+static void benchmark_collision_engine(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	const auto engine = state.range(1);
+
+	Universe initial_uni;
+	InputGenerator::create_random_universe(number_bodies, initial_uni);
+	for (auto _ : state) {
+		state.PauseTiming();
+		Universe uni = initial_uni;
+		std::unique_ptr<Quadtree> quadtree;
+		if (engine == 2) {
+			quadtree = std::make_unique<Quadtree>(uni, uni.get_bounding_box(), 2);
+		}
+		state.ResumeTiming();
+		if (engine == 1) {
+			BarnesHutSimulationWithCollisions::find_collisions_grid(uni);
+		} else if (engine == 2) {
+			BarnesHutSimulationWithCollisions::find_collisions_quadtree(uni, *quadtree);
+		} else {
+			BarnesHutSimulationWithCollisions::find_collisions(uni);
+		}
+	}
+}
+
+// grid collisions with the two compactions of the remaining bodies (bodies, preserve_body_order)
+static void benchmark_collision_compaction(benchmark::State& state) {
+	const auto number_bodies = state.range(0);
+	BarnesHutSimulationWithCollisions::preserve_body_order = state.range(1) != 0;
+
+	Universe initial_uni;
+	InputGenerator::create_random_universe(number_bodies, initial_uni);
+	for (auto _ : state) {
+		state.PauseTiming();
+		Universe uni = initial_uni;
+		state.ResumeTiming();
+		BarnesHutSimulationWithCollisions::find_collisions_grid(uni);
+	}
+	BarnesHutSimulationWithCollisions::preserve_body_order = false;
+}
+
 static void benchmark_find_collisions_parallel(benchmark::State& state) {
 	const auto number_bodies = state.range(0);
 
@@ -205,6 +721,113 @@ BENCHMARK(benchmark_get_bounding_box_sequential)->Unit(benchmark::kMillisecond)-
 BENCHMARK(benchmark_get_bounding_box_parallel)->Unit(benchmark::kMillisecond)->Args({100000});
 BENCHMARK(benchmark_get_bounding_box_parallel)->Unit(benchmark::kMillisecond)->Args({10000000});
 BENCHMARK(benchmark_get_bounding_box_parallel)->Unit(benchmark::kMillisecond)->Args({100000000});
+
+// linear quadtree (construct mode 3) compared with the pointer based modes 0/1/2
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({200000, 0});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({200000, 1});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({200000, 2});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({200000, 3});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({200000, 4});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({10000000, 2});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({10000000, 3});
+BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({10000000, 4});
+
+// thread sweep of the task based constructions, mode 5 with the adaptive and two fixed task cutoffs
+BENCHMARK(benchmark_construct_quadtree_threads)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{1000000}, {2}, {1, 2, 4, 8, 16}, {0}});
+BENCHMARK(benchmark_construct_quadtree_threads)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{1000000}, {5}, {1, 2, 4, 8, 16}, {0, 10000, 100000}});
+
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({100000, 1, 2});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({100000, 1, 3});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 2});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 3});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({100000, 1, 4});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 4});
+// tasks in one parallel region (5) and additionally the moments computed during the construction (6)
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 5});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 6});
+
+// serial against parallel moment aggregation
+BENCHMARK(benchmark_calculate_moments)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{1000000, 10000000}, {1}, {0, 1}});
+BENCHMARK(benchmark_calculate_moments)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{10000000}, {2, 4, 8, 16}, {1}});
+
+// collision detection, all pairs against the uniform grid and the quadtree
+BENCHMARK(benchmark_collision_engine)->Unit(benchmark::kMillisecond)->Args({20000, 0});
+BENCHMARK(benchmark_collision_engine)->Unit(benchmark::kMillisecond)->Args({20000, 1});
+BENCHMARK(benchmark_collision_engine)->Unit(benchmark::kMillisecond)->Args({20000, 2});
+BENCHMARK(benchmark_collision_engine)->Unit(benchmark::kMillisecond)->Args({1000000, 1});
+BENCHMARK(benchmark_collision_engine)->Unit(benchmark::kMillisecond)->Args({1000000, 2});
+BENCHMARK(benchmark_collision_compaction)->Unit(benchmark::kMillisecond)->Args({1000000, 0})->UseRealTime();
+BENCHMARK(benchmark_collision_compaction)->Unit(benchmark::kMillisecond)->Args({1000000, 1})->UseRealTime();
+// all pairs with the parallel cluster merge
+BENCHMARK(benchmark_find_collisions_parallel)->Unit(benchmark::kMillisecond)->Args({20000})->UseRealTime();
+
+// structure-of-arrays layout, compare with benchmark_naive_parallel and benchmark_barnes_hut
+BENCHMARK(benchmark_naive_parallel)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_naive_parallel_soa)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_barnes_hut)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_barnes_hut_soa)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_barnes_hut)->Unit(benchmark::kMillisecond)->Args({1000000, 1});
+BENCHMARK(benchmark_barnes_hut_soa)->Unit(benchmark::kMillisecond)->Args({1000000, 1});
+
+// vectorized all-pairs force kernels (1 -> scalar, 2 -> avx2, 3 -> avx512), compare with the omp simd loop of benchmark_naive_parallel_soa
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({20000, 1});
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({20000, 2});
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({20000, 3});
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({100000, 2});
+BENCHMARK(benchmark_naive_force_kernel)->Unit(benchmark::kMillisecond)->Args({100000, 3});
+
+// Barnes-Hut force engines on the pointer quadtree (0 -> relevant node list, 1 -> explicit stack), compare with benchmark_barnes_hut
+BENCHMARK(benchmark_barnes_hut)->Unit(benchmark::kMillisecond)->Args({100000, 1});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({100000, 1, 0});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({100000, 1, 1});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 0});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 1});
+// bucket traversal (engine 2) against the per-body walk of the linear quadtree (construct mode 3)
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({100000, 1, 3});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({100000, 1, 2});
+BENCHMARK(benchmark_barnes_hut_construct_mode)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 3});
+BENCHMARK(benchmark_barnes_hut_force_engine)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 2});
+
+// quadtree update after 1 and 10 epochs of movement, rebuild (0) against refit (1)
+BENCHMARK(benchmark_barnes_hut_incremental)->Unit(benchmark::kMillisecond)->ArgsProduct({{100000, 1000000}, {1, 10}, {0, 1}});
+
+// euler, leapfrog and yoshida with time steps of 1, 2, 4 and 8 weeks
+BENCHMARK(benchmark_integrator)->Unit(benchmark::kMicrosecond)->ArgsProduct({{0, 1, 2}, {7, 14, 28, 56}});
+
+// memory traffic per epoch: separate passes (0) against the fused epoch pipeline (1)
+BENCHMARK(benchmark_fused_epoch)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{20000}, {5}, {0}, {0, 1}});
+BENCHMARK(benchmark_fused_epoch)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{200000}, {5}, {1}, {0, 1}});
+BENCHMARK(benchmark_fused_epoch)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{20000}, {5}, {2}, {0, 1}});
+
+// individual against global time steps on the black hole scenario
+BENCHMARK(benchmark_block_timesteps)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{10000}, {0, 1}});
+
+// memory locality: Morton order of the bodies for the force calculation and in full epochs (reordering every 1 / 5 epochs)
+BENCHMARK(benchmark_barnes_hut_forces_order)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{1000000}, {0, 1}});
+BENCHMARK(benchmark_barnes_hut_reorder)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{100000}, {5}, {0, 1, 5}});
+
+// theta sweep (in hundredths) for monopole and quadrupole nodes, error against the naive forces
+BENCHMARK(benchmark_barnes_hut_theta)->Unit(benchmark::kMillisecond)->ArgsProduct({{20000}, {20, 40, 60, 80, 100}, {0, 2}});
+
+// double against mixed precision bucket traversal
+BENCHMARK(benchmark_barnes_hut_mixed_precision)->Unit(benchmark::kMillisecond)->UseRealTime()->ArgsProduct({{100000, 1000000}, {2, 3}});
+
+// fast multipole method (bodies, epochs, expansion order, leaf size), compare with the Barnes-Hut engines
+BENCHMARK(benchmark_fast_multipole)->Unit(benchmark::kMillisecond)->Args({100000, 1, 4, 32});
+BENCHMARK(benchmark_fast_multipole)->Unit(benchmark::kMillisecond)->Args({100000, 1, 8, 32});
+BENCHMARK(benchmark_fast_multipole)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 4, 32});
+BENCHMARK(benchmark_fast_multipole)->Unit(benchmark::kMillisecond)->Args({1000000, 1, 4, 64});
+BENCHMARK(benchmark_fast_multipole)->Unit(benchmark::kMillisecond)->Args({10000000, 1, 4, 64});
+
+// tiled all-pairs with symmetric pair evaluation, compare with benchmark_naive_parallel
+BENCHMARK(benchmark_naive_parallel)->Unit(benchmark::kMillisecond)->Args({1000, 1});
+BENCHMARK(benchmark_naive_tiled)->Unit(benchmark::kMillisecond)->Args({1000, 1});
+BENCHMARK(benchmark_naive_parallel)->Unit(benchmark::kMillisecond)->Args({10000, 1});
+BENCHMARK(benchmark_naive_tiled)->Unit(benchmark::kMillisecond)->Args({10000, 1});
+BENCHMARK(benchmark_naive_parallel)->Unit(benchmark::kMillisecond)->Args({50000, 1});
+BENCHMARK(benchmark_naive_tiled)->Unit(benchmark::kMillisecond)->Args({50000, 1});
+BENCHMARK(benchmark_naive_tiled)->Unit(benchmark::kMillisecond)->Args({100000, 1});
 /*
 BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({10000, 0});
 BENCHMARK(benchmark_construct_quadtree)->Unit(benchmark::kMillisecond)->Args({20000, 0});
@@ -7,10 +7,16 @@
 #include <iostream>
 #include "io/image_parser.h"
 #include "structures/universe.h"
+#include "structures/universe_soa.h"
 #include "simulation/naive_sequential_simulation.h"
 #include "simulation/naive_parallel_simulation.h"
+#include "simulation/naive_tiled_simulation.h"
 #include "simulation/barnes_hut_simulation.h"
 #include "simulation/barnes_hut_simulation_with_collisions.h"
+#include "simulation/fast_multipole_simulation.h"
+#include "simulation/integrator.h"
+#include "simulation/block_timestep_simulation.h"
+#include "physics/gravitation.h"
 #include "utilities/export.hpp"
 #include "utilities/import.hpp"
 #include "input_generator/input_generator.h"
@@ -40,6 +46,29 @@ int main(int argc, char** argv) {
 	auto plot_bounding_box_scale = std::uint32_t{5};
 	auto universe_generator = std::uint32_t{ 0 };
 	auto simulation_mode = std::uint32_t{0};
+	auto storage_mode = std::uint32_t{0};
+	auto force_kernel = std::uint32_t{0};
+	auto force_engine = std::uint32_t{0};
+	auto threshold_theta = double{0.2};
+	auto bucket_size = std::uint32_t{16};
+	auto fmm_order = std::uint32_t{4};
+	auto fmm_leaf_size = std::uint32_t{32};
+	auto fmm_theta = double{0.5};
+	auto multipole_order = std::uint32_t{0};
+	auto incremental_tree = false;
+	auto construct_mode = std::uint32_t{2};
+	auto construct_cutoff = std::int32_t{0};
+	auto collision_engine = std::uint32_t{0};
+	auto preserve_body_order = false;
+	auto reorder_interval = std::uint32_t{0};
+	auto integrator = std::uint32_t{0};
+	auto time_step = epoch_in_seconds;
+	auto max_timestep_level = std::int32_t{8};
+	auto timestep_eta = 0.05;
+	auto timestep_length = 1e12;
+	auto fused_epoch = false;
+	auto softening_length = 0.0;
+	auto fast_inverse_sqrt = false;
 
 	lab_cli_app.add_option("--output-image-width", output_image_width, "default: 800px");
 	lab_cli_app.add_option("--output-image-height", output_image_height, "default: 800px");
@@ -51,7 +80,30 @@ int main(int argc, char** argv) {
 	lab_cli_app.add_option("--plot-bounding-box-scale", plot_bounding_box_scale, "Scale of the plotted bounding box compared to the initial bounding box of the system. Default: 5");
 	lab_cli_app.add_option("--universe-generator", universe_generator, "Select universe generator. Options: 0 -> Random universe. 1 -> Earth Orbit. 2 -> Random universe with at least one supermassive black hole. 3 -> Random universe with at least two supermassive black holes. Please feel free to add new generators. 4 -> Create two colliding bodies. Default: 0");
 	auto load_universe_option = lab_cli_app.add_option("--load-universe-path", load_universe_path, "Path to the universe file to be loaded.");
-	lab_cli_app.add_option("--simulation-mode", simulation_mode, "Select simulation mode. Options: 0 -> Naive sequential. 1 -> Naive parallel. 2 -> Barnes-Hut. 3 -> Barnes-Hut with collisions. Default: 0");
+	lab_cli_app.add_option("--simulation-mode", simulation_mode, "Select simulation mode. Options: 0 -> Naive sequential. 1 -> Naive parallel. 2 -> Barnes-Hut. 3 -> Barnes-Hut with collisions. 4 -> Barnes-Hut on a linear (Morton ordered) quadtree. 5 -> Naive parallel with the vectorized force kernel. 6 -> Naive tiled (every pair evaluated once). 7 -> Fast multipole method. 8 -> Barnes-Hut with individual (block) time steps. Default: 0");
+	lab_cli_app.add_option("--storage-mode", storage_mode, "Select the memory layout of the universe. Options: 0 -> Array of structures. 1 -> Structure of arrays (simulation modes 1, 2 and 5 only, Barnes-Hut then uses the linear quadtree; euler with the default time step, no --fused-epoch). Default: 0");
+	lab_cli_app.add_option("--force-kernel", force_kernel, "Select the vectorized force kernel of simulation mode 5. Options: 0 -> Widest instruction set supported by the cpu. 1 -> Scalar. 2 -> AVX2. 3 -> AVX-512. Default: 0");
+	lab_cli_app.add_option("--force-engine", force_engine, "Select the Barnes-Hut force traversal (simulation modes 2 and 3). Options: 0 -> Relevant node list. 1 -> Explicit stack without allocations per body. 2 -> Bucket traversal on a linear quadtree, one interaction list per leaf bucket (see --bucket-size). 3 -> Bucket traversal with the far field in single precision. Simulation mode 3 falls back to 1. Default: 0");
+	lab_cli_app.add_option("--bucket-size", bucket_size, "Maximum number of bodies per leaf bucket of force engine 2. Default: 16");
+	lab_cli_app.add_option("--theta", threshold_theta, "Opening angle of the Barnes-Hut criterion (node diagonal / distance). Larger values are faster but less accurate. Default: 0.2");
+	lab_cli_app.add_option("--multipole-order", multipole_order, "Multipole order of the Barnes-Hut nodes. Options: 0 -> Monopole. 2 -> Monopole and quadrupole. Default: 0");
+	lab_cli_app.add_option("--construct-mode", construct_mode, "Select the quadtree construction of simulation modes 2 and 3. Options: 0 -> Sequential. 1 -> Tasks. 2 -> Tasks with cutoff. 4 -> Sequential with single pass in place partitioning. 5 -> Like 4 with tasks in one parallel region (see --construct-cutoff). 6 -> Like 5, masses and centers of mass are computed during the construction. Default: 2");
+	lab_cli_app.add_option("--construct-cutoff", construct_cutoff, "Subtrees with more bodies than this are built by separate tasks in construct modes 5 and 6. 0 -> Derived from the number of bodies and threads. Default: 0");
+	lab_cli_app.add_option("--collision-engine", collision_engine, "Select the collision detection of simulation mode 3. Options: 0 -> All pairs. 1 -> Uniform grid with the collision distance as cell size. 2 -> Radius queries on the refitted Barnes-Hut quadtree. 3 -> All pairs in parallel, the colliding clusters are merged in parallel. Default: 0");
+	lab_cli_app.add_option("--preserve-body-order", preserve_body_order, "Keep the order of the remaining bodies after collisions (compacted in place) instead of sorting them by decreasing weight. Default: false");
+	lab_cli_app.add_option("--reorder-interval", reorder_interval, "Sort the bodies along the Morton curve every n-th epoch for memory locality (simulation modes 2 and 3). 0 -> Never. Default: 0");
+	lab_cli_app.add_option("--integrator", integrator, "Select the time integration of the array-of-structures simulation modes 1-3 and 5-7. Options: 0 -> Euler. 1 -> Leapfrog (kick-drift-kick). 2 -> 4th order Yoshida (three force evaluations per epoch). Default: 0");
+	lab_cli_app.add_option("--time-step", time_step, "Simulated seconds per epoch for --integrator. Default: 2.628e6 (one month)");
+	lab_cli_app.add_option("--max-timestep-level", max_timestep_level, "Finest time step of simulation mode 8 is --time-step / 2^level, between 0 and 30. Default: 8");
+	lab_cli_app.add_option("--timestep-eta", timestep_eta, "Simulation mode 8 chooses the time step of a body so that its acceleration moves it by at most this fraction of --timestep-length per step. Default: 0.05");
+	lab_cli_app.add_option("--timestep-length", timestep_length, "Length scale in meters of the time step criterion of simulation mode 8. Default: 1e12");
+	lab_cli_app.add_option("--fused-epoch", fused_epoch, "Compute force, velocity and position of a body in the same parallel loop and reduce the next bounding box there (simulation modes 1-5, Euler integrator only). Default: false");
+	lab_cli_app.add_option("--softening-length", softening_length, "Plummer softening length in meters of the naive and Barnes-Hut force kernels and the near field of the fast multipole method, F = G * m1 * m2 * d / (d^2 + length^2)^(3/2). Default: 0 (no softening)");
+	lab_cli_app.add_option("--fast-inverse-sqrt", fast_inverse_sqrt, "Compute 1 / d of the naive and Barnes-Hut force kernels with a single reciprocal square root and Newton refinement instead of sqrt and a division. Default: false");
+	lab_cli_app.add_option("--incremental-tree", incremental_tree, "Keep the Barnes-Hut quadtree across epochs and only reinsert bodies that left their leaf (simulation mode 2, force engines 0 and 1). Default: false");
+	lab_cli_app.add_option("--fmm-order", fmm_order, "Expansion order of the fast multipole method (simulation mode 7), between 1 and 12. Default: 4");
+	lab_cli_app.add_option("--fmm-leaf-size", fmm_leaf_size, "Maximum number of bodies per leaf of the fast multipole method. Default: 32");
+	lab_cli_app.add_option("--fmm-theta", fmm_theta, "Opening parameter of the fast multipole method, cells interact through expansions if (radius_a + radius_b) < theta * distance. Default: 0.5");
 	lab_cli_app.add_option("--save-initial-universe", save_initial_universe, "Toggle saving the initial universe to --save-universe-path. Default: true");
 
 	auto output_option = lab_cli_app.add_option("--output", output_path, "Required argument. Set the path to the output directory. MUST contain 'scratch'.");
@@ -72,6 +124,96 @@ int main(int argc, char** argv) {
 	}
 	output_option->check(CLI::ExistingDirectory);
 
+	// simulation settings, checked before anything is written
+	if(force_kernel > static_cast<std::uint32_t>(NaiveForceKernelType::avx512)){
+		throw std::invalid_argument("unknown force kernel: " + std::to_string(force_kernel));
+	}
+	NaiveParallelSimulation::force_kernel = static_cast<NaiveForceKernelType>(force_kernel);
+	if(force_engine > 3){
+		throw std::invalid_argument("unknown force engine: " + std::to_string(force_engine));
+	}
+	BarnesHutSimulation::force_engine = static_cast<std::int8_t>(force_engine);
+	if(bucket_size == 0){
+		throw std::invalid_argument("--bucket-size must be positive");
+	}
+	BarnesHutSimulation::bucket_size = bucket_size;
+	if(fmm_order < 1 || fmm_order > FastMultipoleSimulation::max_expansion_order){
+		throw std::invalid_argument("--fmm-order must be between 1 and " + std::to_string(FastMultipoleSimulation::max_expansion_order));
+	}
+	if(fmm_leaf_size == 0){
+		throw std::invalid_argument("--fmm-leaf-size must be positive");
+	}
+	if(fmm_theta <= 0 || fmm_theta >= 1){
+		throw std::invalid_argument("--fmm-theta must be between 0 and 1");
+	}
+	FastMultipoleSimulation::expansion_order = fmm_order;
+	FastMultipoleSimulation::max_leaf_size = fmm_leaf_size;
+	FastMultipoleSimulation::threshold_theta = fmm_theta;
+	if(threshold_theta <= 0){
+		throw std::invalid_argument("--theta must be positive");
+	}
+	BarnesHutSimulation::threshold_theta = threshold_theta;
+	if(multipole_order != 0 && multipole_order != 2){
+		throw std::invalid_argument("unsupported multipole order: " + std::to_string(multipole_order));
+	}
+	BarnesHutSimulation::multipole_order = static_cast<std::int8_t>(multipole_order);
+	BarnesHutSimulation::incremental_tree = incremental_tree;
+	if(construct_mode > 6 || construct_mode == 3){
+		throw std::invalid_argument("unsupported construct mode: " + std::to_string(construct_mode) + ", use simulation mode 4 for the linear quadtree");
+	}
+	BarnesHutSimulation::construct_mode = static_cast<std::int8_t>(construct_mode);
+	if(construct_cutoff < 0){
+		throw std::invalid_argument("--construct-cutoff must not be negative");
+	}
+	Quadtree::construct_task_cutoff = construct_cutoff;
+	if(collision_engine > 3){
+		throw std::invalid_argument("unknown collision engine: " + std::to_string(collision_engine));
+	}
+	BarnesHutSimulationWithCollisions::collision_engine = static_cast<std::int8_t>(collision_engine);
+	BarnesHutSimulationWithCollisions::preserve_body_order = preserve_body_order;
+	BarnesHutSimulation::reorder_interval = reorder_interval;
+	if(integrator > static_cast<std::uint32_t>(IntegratorType::yoshida4)){
+		throw std::invalid_argument("unknown integrator: " + std::to_string(integrator));
+	}
+	if(!(time_step > 0)){
+		throw std::invalid_argument("--time-step must be positive");
+	}
+	Integrator::integrator = static_cast<IntegratorType>(integrator);
+	Integrator::time_step = time_step;
+	NaiveParallelSimulation::fused_epoch = fused_epoch;
+	if(!(softening_length >= 0)){
+		throw std::invalid_argument("--softening-length must not be negative");
+	}
+	Gravitation::softening_length = softening_length;
+	Gravitation::fast_inverse_sqrt = fast_inverse_sqrt;
+	BarnesHutSimulation::fused_epoch = fused_epoch;
+	if(max_timestep_level < 0 || max_timestep_level > 30){
+		throw std::invalid_argument("--max-timestep-level must be between 0 and 30");
+	}
+	if(!(timestep_eta > 0)){
+		throw std::invalid_argument("--timestep-eta must be positive");
+	}
+	if(!(timestep_length > 0)){
+		throw std::invalid_argument("--timestep-length must be positive");
+	}
+	// the substeps compute the forces of single bodies with the explicit stack on the pointer quadtree
+	if(simulation_mode == 8 && force_engine > 1){
+		throw std::invalid_argument("simulation mode 8 only supports --force-engine 0 and 1");
+	}
+	BlockTimestepSimulation::max_level = max_timestep_level;
+	BlockTimestepSimulation::timestep_eta = timestep_eta;
+	BlockTimestepSimulation::timestep_length = timestep_length;
+	// the structure-of-arrays epochs always step with euler and epoch_in_seconds
+	if(storage_mode == 1 && (Integrator::integrator != IntegratorType::euler || time_step != epoch_in_seconds || fused_epoch)){
+		throw std::invalid_argument("--storage-mode 1 does not support --integrator, --time-step or --fused-epoch");
+	}
+	if(storage_mode > 1){
+		throw std::invalid_argument("unknown storage mode: " + std::to_string(storage_mode));
+	}
+	if(storage_mode == 1 && simulation_mode != 1 && simulation_mode != 2 && simulation_mode != 5){
+		throw std::invalid_argument("simulation mode " + std::to_string(simulation_mode) + " does not support --storage-mode 1");
+	}
+
 
 	// check if a universe shall be loaded or created
 	auto universe = Universe();
@@ -105,6 +247,8 @@ int main(int argc, char** argv) {
 				throw std::invalid_argument("Invalid Argument for --universe-generator");
 		}		
 	}
+	// ids of loaded universes are kept, generated bodies are numbered by their initial slot
+	universe.assign_body_ids();
 
 	// create output_path if not already existing
 	if(!std::filesystem::is_directory(output_path)){
@@ -130,21 +274,63 @@ int main(int argc, char** argv) {
 	}
 
 	// simulate universe
-	switch(simulation_mode){
-		case 0:
-			NaiveSequentialSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
-			break;
-		case 1:
-			NaiveParallelSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
-			break;
-		case 2:
-			BarnesHutSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
-			break;
-		case 3:
-			BarnesHutSimulationWithCollisions::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
-			break;
-		default:
-			throw std::invalid_argument("unknown simulation mode: " + std::to_string(simulation_mode));
+	std::cout << "integrator: " << get_integrator_name(Integrator::integrator) << ", time step: " << time_step << "s" << std::endl;
+	if(simulation_mode == 5){
+		std::cout << "force kernel: " << get_naive_force_kernel_name(NaiveParallelSimulation::force_kernel) << std::endl;
+	}
+
+	if(storage_mode == 1){
+		UniverseSoA universe_soa(universe);
+		switch(simulation_mode){
+			case 1:
+				NaiveParallelSimulation::simulate_epochs(plotter, universe_soa, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 2:
+				BarnesHutSimulation::simulate_epochs(plotter, universe_soa, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 5:
+				NaiveParallelSimulation::use_simd_kernel = true;
+				NaiveParallelSimulation::simulate_epochs(plotter, universe_soa, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			default:
+				throw std::invalid_argument("simulation mode " + std::to_string(simulation_mode) + " does not support --storage-mode 1");
+		}
+		universe_soa.store(universe);
+	}
+	else{
+		switch(simulation_mode){
+			case 0:
+				NaiveSequentialSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 1:
+				NaiveParallelSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 2:
+				BarnesHutSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 3:
+				BarnesHutSimulationWithCollisions::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 4:
+				BarnesHutSimulation::construct_mode = 3;
+				BarnesHutSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 5:
+				NaiveParallelSimulation::use_simd_kernel = true;
+				NaiveParallelSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 6:
+				NaiveTiledSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 7:
+				FastMultipoleSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			case 8:
+				BlockTimestepSimulation::simulate_epochs(plotter, universe, number_epochs, output_intermediate_states, plot_intermediate_epochs);
+				break;
+			default:
+				throw std::invalid_argument("unknown simulation mode: " + std::to_string(simulation_mode));
+		}
 	}
 
 	// plot simulation result
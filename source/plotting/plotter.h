@@ -5,6 +5,7 @@
 #include "quadtree/quadtreeNode.h"
 #include "quadtree/quadtree.h"
 #include "structures/universe.h"
+#include "structures/universe_soa.h"
 #include <cstdint>
 #include <set>
 
@@ -16,6 +17,7 @@ public:
     }
 
     void add_bodies_to_image(Universe& universe);
+    void add_bodies_to_image(UniverseSoA& universe);
     void highlight_position(Vector2d<double> position, std::uint8_t red, std::uint8_t green, std::uint8_t blue);
     
     void set_plot_bounding_box(BoundingBox bb){
@@ -3,7 +3,15 @@
 
 void Plotter::add_quadtree_to_bitmap(Quadtree& quadtree){
     // fill bitmap with quadtree bounding boxes
-    std::vector<BoundingBox> bounding_boxes = quadtree.get_bounding_boxes(quadtree.root);
+    std::vector<BoundingBox> bounding_boxes;
+    if(quadtree.is_linear()){
+        for(const auto& node : quadtree.linear_quadtree.nodes){
+            bounding_boxes.push_back(node.bounding_box);
+        }
+    }
+    else{
+        bounding_boxes = quadtree.get_bounding_boxes(quadtree.root);
+    }
     std::set<std::tuple<std::uint32_t, std::uint32_t>> bounding_box_pixels = get_bounding_box_pixels(bounding_boxes);
     for(auto pixel_pair : bounding_box_pixels){
         Pixel<std::uint8_t> green_pixel = Pixel<std::uint8_t>(0, 255, 0); 
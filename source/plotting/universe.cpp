@@ -17,5 +17,15 @@ void Plotter::add_bodies_to_image(Universe& universe){
     }
 }
 
+void Plotter::add_bodies_to_image(UniverseSoA& universe){
+    for(std::uint32_t i = 0; i < universe.num_bodies; i++){
+        Vector2d<double> position(universe.positions.x[i], universe.positions.y[i]);
+        if(!plot_bounding_box.contains(position)){
+            // body not within the plotted box
+            continue;
+        }
 
-
+        // plot pixel
+        mark_position(position, 255, 255, 255);
+    }
+}
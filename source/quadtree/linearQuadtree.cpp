@@ -0,0 +1,228 @@
+#include "quadtree/linearQuadtree.h"
+#include "quadtree/morton.h"
+
+#include <algorithm>
+#include <omp.h>
+
+void LinearQuadtree::construct(Universe& universe, BoundingBox arg_bounding_box, std::uint32_t max_leaf_size){
+    bounding_box = arg_bounding_box;
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+
+    // compute Morton keys and sort the bodies along the Z-curve
+    morton_keys.resize(num_bodies);
+    body_indices.resize(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        morton_keys[i] = morton_key(universe.positions[i][0], universe.positions[i][1], bounding_box);
+        body_indices[i] = i;
+    }
+    morton_radix_sort(morton_keys, body_indices);
+
+    // gather the body data in Morton order
+    body_x.resize(num_bodies);
+    body_y.resize(num_bodies);
+    body_mass.resize(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        std::int32_t body_index = body_indices[i];
+        body_x[i] = universe.positions[body_index][0];
+        body_y[i] = universe.positions[body_index][1];
+        body_mass[i] = universe.weights[body_index];
+    }
+
+    construct_nodes(max_leaf_size);
+}
+
+void LinearQuadtree::construct(UniverseSoA& universe, BoundingBox arg_bounding_box, std::uint32_t max_leaf_size){
+    bounding_box = arg_bounding_box;
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+
+    morton_keys.resize(num_bodies);
+    body_indices.resize(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        morton_keys[i] = morton_key(universe.positions.x[i], universe.positions.y[i], bounding_box);
+        body_indices[i] = i;
+    }
+    morton_radix_sort(morton_keys, body_indices);
+
+    body_x.resize(num_bodies);
+    body_y.resize(num_bodies);
+    body_mass.resize(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        std::int32_t body_index = body_indices[i];
+        body_x[i] = universe.positions.x[body_index];
+        body_y[i] = universe.positions.y[body_index];
+        body_mass[i] = universe.weights[body_index];
+    }
+
+    construct_nodes(max_leaf_size);
+}
+
+void LinearQuadtree::construct_nodes(std::uint32_t max_leaf_size){
+    if(max_leaf_size == 0){
+        max_leaf_size = 1;
+    }
+    const std::int32_t num_bodies = static_cast<std::int32_t>(body_indices.size());
+
+    // build the nodes breadth first, so the children of a node end up next to each other
+    nodes.clear();
+    nodes.reserve(2 * static_cast<std::size_t>(num_bodies) / max_leaf_size + 1);
+
+    LinearQuadtreeNode root;
+    root.bounding_box = bounding_box;
+    root.diagonal = root.bounding_box.get_diagonal();
+    root.first_body = 0;
+    root.body_count = num_bodies;
+    nodes.push_back(root);
+
+    for(std::size_t node_index = 0; node_index < nodes.size(); node_index++){
+        // copy, push_back may reallocate the node storage
+        const LinearQuadtreeNode node = nodes[node_index];
+
+        if(node.body_count == 1){
+            nodes[node_index].body_identifier = body_indices[node.first_body];
+        }
+        // leaf: few enough bodies or keys are identical on all levels
+        if(node.body_count <= static_cast<std::int32_t>(max_leaf_size) || node.level >= static_cast<std::int32_t>(morton_bits_per_dimension)){
+            continue;
+        }
+
+        double xmid = node.bounding_box.x_min + (node.bounding_box.x_max - node.bounding_box.x_min)/2;
+        double ymid = node.bounding_box.y_min + (node.bounding_box.y_max - node.bounding_box.y_min)/2;
+
+        // the keys of the node range are sorted, so each quadrant is a contiguous subrange
+        auto keys_begin = morton_keys.begin() + node.first_body;
+        auto keys_end = keys_begin + node.body_count;
+        std::int32_t first_child = static_cast<std::int32_t>(nodes.size());
+        std::int32_t child_count = 0;
+
+        for(std::uint32_t quadrant = 0; quadrant < 4; quadrant++){
+            auto quadrant_end = std::partition_point(keys_begin, keys_end, [&](std::uint64_t key){
+                return morton_quadrant(key, node.level) <= quadrant;
+            });
+            std::int32_t quadrant_count = static_cast<std::int32_t>(quadrant_end - keys_begin);
+            if(quadrant_count > 0){
+                LinearQuadtreeNode child;
+                // even bits of the key hold x, odd bits hold y
+                bool upper_x = (quadrant & 1) != 0;
+                bool upper_y = (quadrant & 2) != 0;
+                child.bounding_box = BoundingBox(upper_x ? xmid : node.bounding_box.x_min, upper_x ? node.bounding_box.x_max : xmid,
+                                                 upper_y ? ymid : node.bounding_box.y_min, upper_y ? node.bounding_box.y_max : ymid);
+                child.diagonal = child.bounding_box.get_diagonal();
+                child.first_body = static_cast<std::int32_t>(keys_begin - morton_keys.begin());
+                child.body_count = quadrant_count;
+                child.level = node.level + 1;
+                nodes.push_back(child);
+                child_count++;
+            }
+            keys_begin = quadrant_end;
+        }
+
+        nodes[node_index].first_child = first_child;
+        nodes[node_index].child_count = child_count;
+    }
+
+    // the keys are computed from the coordinates relative to the root box, the midpoints from the boxes of the parents.
+    // both are rounded, a body right at a midpoint can end up in the neighbouring quadrant. the boxes are grown to contain
+    // their bodies, otherwise box pruning (Quadtree::query_radius) could miss them
+    for(std::size_t k = nodes.size(); k > 0; k--){
+        LinearQuadtreeNode& node = nodes[k - 1];
+        BoundingBox& box = node.bounding_box;
+        if(node.is_leaf()){
+            for(std::int32_t i = node.first_body; i < node.first_body + node.body_count; i++){
+                box.x_min = std::min(box.x_min, body_x[i]);
+                box.x_max = std::max(box.x_max, body_x[i]);
+                box.y_min = std::min(box.y_min, body_y[i]);
+                box.y_max = std::max(box.y_max, body_y[i]);
+            }
+        }
+        else{
+            for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++){
+                const BoundingBox& child_box = nodes[c].bounding_box;
+                box.x_min = std::min(box.x_min, child_box.x_min);
+                box.x_max = std::max(box.x_max, child_box.x_max);
+                box.y_min = std::min(box.y_min, child_box.y_min);
+                box.y_max = std::max(box.y_max, child_box.y_max);
+            }
+        }
+    }
+
+    calculate_moments();
+}
+
+void LinearQuadtree::calculate_moments(){
+    // children have larger indices than their parents, a reverse sweep is a bottom-up traversal
+    for(std::size_t k = nodes.size(); k > 0; k--){
+        LinearQuadtreeNode& node = nodes[k - 1];
+        double mass = 0.0;
+        double weighted_x = 0.0;
+        double weighted_y = 0.0;
+
+        if(node.body_count == 1){
+            node.cumulative_mass = body_mass[node.first_body];
+            node.center_of_mass_x = body_x[node.first_body];
+            node.center_of_mass_y = body_y[node.first_body];
+            continue;
+        }
+        if(node.is_leaf()){
+            for(std::int32_t i = node.first_body; i < node.first_body + node.body_count; i++){
+                mass += body_mass[i];
+                weighted_x += body_x[i] * body_mass[i];
+                weighted_y += body_y[i] * body_mass[i];
+            }
+        }
+        else{
+            for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++){
+                const LinearQuadtreeNode& child = nodes[c];
+                mass += child.cumulative_mass;
+                weighted_x += child.center_of_mass_x * child.cumulative_mass;
+                weighted_y += child.center_of_mass_y * child.cumulative_mass;
+            }
+        }
+
+        node.cumulative_mass = mass;
+        if(mass > 0){
+            node.center_of_mass_x = weighted_x / mass;
+            node.center_of_mass_y = weighted_y / mass;
+        }
+    }
+}
+
+void LinearQuadtree::calculate_quadrupole_moments(){
+    // bottom-up like calculate_moments, the centers of mass are already known
+    for(std::size_t k = nodes.size(); k > 0; k--){
+        LinearQuadtreeNode& node = nodes[k - 1];
+        double qxx = 0.0;
+        double qxy = 0.0;
+        double qyy = 0.0;
+
+        auto add_point = [&](double x, double y, double m){
+            double sx = x - node.center_of_mass_x;
+            double sy = y - node.center_of_mass_y;
+            qxx += m * (2 * sx * sx - sy * sy);
+            qyy += m * (2 * sy * sy - sx * sx);
+            qxy += m * 3 * sx * sy;
+        };
+
+        if(node.is_leaf()){
+            for(std::int32_t i = node.first_body; i < node.first_body + node.body_count; i++){
+                add_point(body_x[i], body_y[i], body_mass[i]);
+            }
+        }
+        else{
+            for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++){
+                const LinearQuadtreeNode& child = nodes[c];
+                qxx += child.quadrupole_xx;
+                qxy += child.quadrupole_xy;
+                qyy += child.quadrupole_yy;
+                add_point(child.center_of_mass_x, child.center_of_mass_y, child.cumulative_mass);
+            }
+        }
+
+        node.quadrupole_xx = qxx;
+        node.quadrupole_xy = qxy;
+        node.quadrupole_yy = qyy;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "structures/bounding_box.h"
+#include "structures/universe.h"
+#include "structures/universe_soa.h"
+
+// node of the linear quadtree, children are stored contiguously and referenced by index
+struct LinearQuadtreeNode{
+    BoundingBox bounding_box;
+    double diagonal = 0.0;
+    double center_of_mass_x = 0.0;
+    double center_of_mass_y = 0.0;
+    double cumulative_mass = 0.0;
+    // traceless quadrupole around the center of mass, only filled by calculate_quadrupole_moments
+    double quadrupole_xx = 0.0;
+    double quadrupole_xy = 0.0;
+    double quadrupole_yy = 0.0;
+    std::int32_t first_child = -1;   // index of the first child in LinearQuadtree::nodes
+    std::int32_t child_count = 0;
+    std::int32_t first_body = 0;     // range of the node in the Morton ordered body arrays
+    std::int32_t body_count = 0;
+    std::int32_t body_identifier = -1;  // set if the node is a leaf with exactly one body
+    std::int32_t level = 0;
+
+    [[nodiscard]] bool is_leaf() const {
+        return child_count == 0;
+    }
+};
+
+// pointer free quadtree: bodies are sorted by their 64-bit Morton key and every node covers a contiguous range
+class LinearQuadtree{
+public:
+    void construct(Universe& universe, BoundingBox arg_bounding_box, std::uint32_t max_leaf_size);
+    void construct(UniverseSoA& universe, BoundingBox arg_bounding_box, std::uint32_t max_leaf_size);
+    void calculate_moments();
+    void calculate_quadrupole_moments();
+
+    [[nodiscard]] bool empty() const {
+        return nodes.empty();
+    }
+
+    BoundingBox bounding_box;
+    std::vector<LinearQuadtreeNode> nodes;   // nodes[0] is the root, children always have a larger index than their parent
+
+    // bodies in Morton order
+    std::vector<std::uint64_t> morton_keys;
+    std::vector<std::int32_t> body_indices;   // index of the body in the universe
+    std::vector<double> body_x;
+    std::vector<double> body_y;
+    std::vector<double> body_mass;
+
+private:
+    void construct_nodes(std::uint32_t max_leaf_size);
+};
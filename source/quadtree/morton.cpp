@@ -0,0 +1,83 @@
+#include "quadtree/morton.h"
+
+#include <algorithm>
+#include <omp.h>
+
+void morton_radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::int32_t>& values){
+    const std::size_t n = keys.size();
+    if(n < 2){
+        return;
+    }
+
+    std::vector<std::uint64_t> keys_buffer(n);
+    std::vector<std::int32_t> values_buffer(n);
+
+    // one histogram with 256 buckets per thread
+    const int max_threads = omp_get_max_threads();
+    std::vector<std::size_t> histograms(static_cast<std::size_t>(max_threads) * 256);
+
+    for(std::uint32_t shift = 0; shift < 64; shift += 8){
+        bool skip_pass = false;
+
+        #pragma omp parallel num_threads(max_threads)
+        {
+            const std::size_t thread_id = omp_get_thread_num();
+            const std::size_t thread_count = omp_get_num_threads();
+            const std::size_t begin = n * thread_id / thread_count;
+            const std::size_t end = n * (thread_id + 1) / thread_count;
+            std::size_t* count = &histograms[thread_id * 256];
+
+            std::fill(count, count + 256, 0);
+            for(std::size_t i = begin; i < end; i++){
+                count[(keys[i] >> shift) & 0xFF]++;
+            }
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                // exclusive prefix sum ordered by (digit, thread) keeps the sort stable
+                std::size_t offset = 0;
+                for(std::size_t digit = 0; digit < 256; digit++){
+                    std::size_t digit_total = 0;
+                    for(std::size_t t = 0; t < thread_count; t++){
+                        std::size_t c = histograms[t * 256 + digit];
+                        histograms[t * 256 + digit] = offset;
+                        offset += c;
+                        digit_total += c;
+                    }
+                    // all keys share this digit, the pass would not change anything
+                    if(digit_total == n){
+                        skip_pass = true;
+                    }
+                }
+            }
+
+            if(!skip_pass){
+                for(std::size_t i = begin; i < end; i++){
+                    std::size_t position = count[(keys[i] >> shift) & 0xFF]++;
+                    keys_buffer[position] = keys[i];
+                    values_buffer[position] = values[i];
+                }
+            }
+        }
+
+        if(!skip_pass){
+            keys.swap(keys_buffer);
+            values.swap(values_buffer);
+        }
+    }
+}
+
+void morton_reorder(Universe& universe){
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    BoundingBox bounding_box = universe.get_bounding_box();
+    std::vector<std::uint64_t> keys(num_bodies);
+    std::vector<std::int32_t> order(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        keys[i] = morton_key(universe.positions[i][0], universe.positions[i][1], bounding_box);
+        order[i] = i;
+    }
+    morton_radix_sort(keys, order);
+    universe.apply_permutation(order);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "structures/bounding_box.h"
+#include "structures/universe.h"
+
+// number of bits per dimension used for the quantized coordinates, 2 * 32 bits form one 64-bit Morton key
+static const std::uint32_t morton_bits_per_dimension = 32;
+
+// spread the lower 32 bits of value so that there is a zero bit between every two bits
+[[nodiscard]] static inline std::uint64_t morton_spread_bits(std::uint64_t value){
+    value &= 0x00000000FFFFFFFFull;
+    value = (value | (value << 16)) & 0x0000FFFF0000FFFFull;
+    value = (value | (value << 8)) & 0x00FF00FF00FF00FFull;
+    value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    value = (value | (value << 2)) & 0x3333333333333333ull;
+    value = (value | (value << 1)) & 0x5555555555555555ull;
+    return value;
+}
+
+// map a coordinate to [0, 2^32 - 1] relative to the interval [min, max]: the index of its cell when the interval is split
+// into 2^32 equal cells, so bit 31 - l is the half of its node on level l
+[[nodiscard]] static inline std::uint32_t morton_quantize(double value, double min, double max){
+    double extent = max - min;
+    if(!(extent > 0)){
+        return 0;
+    }
+    double normalized = (value - min) / extent;
+    if(normalized <= 0.0){
+        return 0;
+    }
+    if(normalized >= 1.0){
+        return 0xFFFFFFFFu;
+    }
+    return static_cast<std::uint32_t>(std::floor(normalized * 4294967296.0));
+}
+
+// interleave the quantized coordinates, x occupies the even and y the odd bits
+[[nodiscard]] static inline std::uint64_t morton_key(double x, double y, const BoundingBox& bounding_box){
+    std::uint64_t qx = morton_quantize(x, bounding_box.x_min, bounding_box.x_max);
+    std::uint64_t qy = morton_quantize(y, bounding_box.y_min, bounding_box.y_max);
+    return morton_spread_bits(qx) | (morton_spread_bits(qy) << 1);
+}
+
+// quadrant (0..3) of a key on the given tree level, level 0 splits the root bounding box
+[[nodiscard]] static inline std::uint32_t morton_quadrant(std::uint64_t key, std::uint32_t level){
+    return static_cast<std::uint32_t>((key >> (2 * (morton_bits_per_dimension - 1 - level))) & 0x3);
+}
+
+// stable LSD radix sort of the keys, values are permuted alongside
+void morton_radix_sort(std::vector<std::uint64_t>& keys, std::vector<std::int32_t>& values);
+
+// sorts all bodies of the universe along the Morton curve of its bounding box, neighbours in space end up close in memory
+void morton_reorder(Universe& universe);
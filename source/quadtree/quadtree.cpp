@@ -1,12 +1,30 @@
 #include "quadtree.h"
 #include "quadtreeNode.h"
 #include <set>
+#include <array>
 #include <algorithm>
 #include <stdexcept>
 #include <omp.h>
 
-Quadtree::Quadtree(Universe& universe, BoundingBox bounding_box, std::int8_t construct_mode) {
-    root = new QuadtreeNode(bounding_box);
+static QuadtreeNode* create_leaf(QuadtreeNodeArena& node_arena, Universe& universe, BoundingBox box, std::int32_t body_index, QuadtreeNode* parent) {
+    QuadtreeNode* leaf_node = node_arena.allocate(box);
+    leaf_node->body_identifier = body_index;
+    leaf_node->cumulative_mass = universe.weights[body_index];
+    leaf_node->center_of_mass = universe.positions[body_index];
+    leaf_node->cumulative_mass_ready = true;
+    leaf_node->center_of_mass_ready = true;
+    leaf_node->quadrupole_ready = true;
+    leaf_node->parent = parent;
+    return leaf_node;
+}
+
+Quadtree::Quadtree(Universe& universe, BoundingBox bounding_box, std::int8_t construct_mode, std::uint32_t max_leaf_size) {
+    if (construct_mode == 3) {
+        // linear quadtree: Morton ordered bodies, flat node array
+        linear_quadtree.construct(universe, bounding_box, max_leaf_size);
+        return;
+    }
+    root = node_arena.allocate(bounding_box);
     std::vector<int> indices;
     for (int i = 0; i < universe.num_bodies; ++i) {
         indices.push_back(i);
@@ -21,26 +39,76 @@ Quadtree::Quadtree(Universe& universe, BoundingBox bounding_box, std::int8_t con
     case 2:
         root->children = construct_task_with_cutoff(universe, bounding_box, indices);
         break;
+    case 4: {
+        std::vector<std::uint8_t> quadrant_codes(indices.size());
+        root->children = construct_partitioned(universe, bounding_box, indices.data(), quadrant_codes.data(), static_cast<std::int32_t>(indices.size()));
+        break;
+    }
+    case 5:
+    case 6: {
+        std::vector<std::uint8_t> quadrant_codes(indices.size());
+        std::int32_t count = static_cast<std::int32_t>(indices.size());
+        std::int32_t task_cutoff = construct_task_cutoff > 0 ? construct_task_cutoff : adaptive_task_cutoff(count, omp_get_max_threads());
+        bool with_moments = construct_mode == 6;
+        #pragma omp parallel
+        #pragma omp single
+        construct_adaptive(universe, root, indices.data(), quadrant_codes.data(), count, task_cutoff, with_moments);
+        break;
+    }
     default:
         throw std::invalid_argument("Invalid construct_mode");
     }
 }
 
+Quadtree::Quadtree(UniverseSoA& universe, BoundingBox bounding_box, std::uint32_t max_leaf_size) {
+    linear_quadtree.construct(universe, bounding_box, max_leaf_size);
+}
+
 Quadtree::~Quadtree() {
-  delete root;
+  // the nodes are released with node_arena
   root = nullptr;
 }
 
 void Quadtree::calculate_cumulative_masses() {
+    // the linear quadtree computes its moments during construction
+    if(is_linear()) {
+        return;
+    }
     root->calculate_node_cumulative_mass();
 }
 
 void Quadtree::calculate_center_of_mass() {
+    if(is_linear()) {
+        return;
+    }
     root->calculate_node_center_of_mass();
 }
 
+void Quadtree::calculate_moments() {
+    if(is_linear()) {
+        // the linear quadtree computes its moments during construction
+        return;
+    }
+    // enough levels for about 16 tasks per thread, 4^task_depth subtrees
+    std::int32_t task_depth = 1;
+    while((1 << (2 * task_depth)) < 16 * omp_get_max_threads() && task_depth < 8) {
+        task_depth++;
+    }
+    #pragma omp parallel
+    #pragma omp single
+    root->calculate_node_moments(task_depth);
+}
+
+void Quadtree::calculate_quadrupole_moments() {
+    if(is_linear()) {
+        linear_quadtree.calculate_quadrupole_moments();
+        return;
+    }
+    root->calculate_node_quadrupole();
+}
 
-std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices) {
+
+QuadtreeNodeChildren Quadtree::construct(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices) {
 
     // Basisfall: Kein Körper im Bereich
     if (body_indices.empty()) {
@@ -49,7 +117,7 @@ std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox B
     }
 // Basisfall: Genau ein Körper -> Blattknoten
     if (body_indices.size() == 1) {
-        QuadtreeNode* leaf_node = new QuadtreeNode(BB);
+        QuadtreeNode* leaf_node = node_arena.allocate(BB);
         int body_index = body_indices[0];
         leaf_node->body_identifier = body_index;
         leaf_node->cumulative_mass = universe.weights[body_index];
@@ -69,7 +137,7 @@ std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox B
     const BoundingBox Q4 = BoundingBox(xmid, BB.x_max, BB.y_min ,ymid);
     std::vector<BoundingBox> sub_boxes = {Q1, Q2, Q3, Q4};
 
-    std::vector<QuadtreeNode*> children_nodes;
+    QuadtreeNodeChildren children_nodes;
 
     for (auto& sub_box : sub_boxes) {
         std::vector<int32_t> sub_indices;
@@ -85,7 +153,7 @@ std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox B
         if (!sub_indices.empty()) {
             //Kind ist ein Blattknoten
             if(sub_indices.size() == 1) {
-                QuadtreeNode* leaf_node = new QuadtreeNode(sub_box);
+                QuadtreeNode* leaf_node = node_arena.allocate(sub_box);
                 int body_index = sub_indices[0];
                 leaf_node->body_identifier = body_index;
                 leaf_node->cumulative_mass = universe.weights[body_index];
@@ -94,7 +162,7 @@ std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox B
                 leaf_node->center_of_mass_ready = true;
                 children_nodes.push_back(leaf_node);
             } else { //Kind hat mehr als einen Himmelskörper und ist somit kein Blatt
-                QuadtreeNode* child_node = new QuadtreeNode(sub_box);
+                QuadtreeNode* child_node = node_arena.allocate(sub_box);
                 auto sub_children = construct(universe, sub_box, sub_indices);
                 child_node->children = sub_children;
                 children_nodes.push_back(child_node);
@@ -105,14 +173,14 @@ std::vector<QuadtreeNode*> Quadtree::construct(Universe& universe, BoundingBox B
     return children_nodes; // Rückgabe aller Subknoten
 }
 
-std::vector<QuadtreeNode*> Quadtree::construct_task(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices) {
+QuadtreeNodeChildren Quadtree::construct_task(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices) {
      // Basisfall: Kein Körper im Bereich
     if (body_indices.empty()) {
         return {};
     }
 // Basisfall: Genau ein Körper -> Blattknoten
     if (body_indices.size() == 1) {
-        QuadtreeNode* leaf_node = new QuadtreeNode(BB);
+        QuadtreeNode* leaf_node = node_arena.allocate(BB);
         int body_index = body_indices[0];
         leaf_node->body_identifier = body_index;
         leaf_node->cumulative_mass = universe.weights[body_index];
@@ -132,12 +200,12 @@ std::vector<QuadtreeNode*> Quadtree::construct_task(Universe& universe, Bounding
     const BoundingBox Q4 = BoundingBox(xmid, BB.x_max, BB.y_min ,ymid);
     std::vector<BoundingBox> sub_boxes = {Q1, Q2, Q3, Q4};
 
-    std::vector<QuadtreeNode*> children_nodes;
+    QuadtreeNodeChildren children_nodes;
 
     #pragma omp parallel
     {
         // Liste für lokal generierte Knoten
-        std::vector<QuadtreeNode*> local_children;
+        QuadtreeNodeChildren local_children;
 
         #pragma omp single
         {
@@ -156,7 +224,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task(Universe& universe, Bounding
                     #pragma omp task shared(local_children)
                     {
                        if (sub_indices.size() == 1) {
-                            QuadtreeNode* leaf_node = new QuadtreeNode(sub_box);
+                            QuadtreeNode* leaf_node = node_arena.allocate(sub_box);
                             int body_index = sub_indices[0];
                             leaf_node->body_identifier = body_index;
                             leaf_node->cumulative_mass = universe.weights[body_index];
@@ -168,7 +236,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task(Universe& universe, Bounding
                             local_children.push_back(leaf_node);
                         }else{
 
-                        QuadtreeNode* child_node = new QuadtreeNode(sub_box);
+                        QuadtreeNode* child_node = node_arena.allocate(sub_box);
                         auto sub_children = construct_task(universe, sub_box, sub_indices);
                         child_node->children = sub_children;
 
@@ -181,13 +249,15 @@ std::vector<QuadtreeNode*> Quadtree::construct_task(Universe& universe, Bounding
         }
 
         #pragma omp critical
-        children_nodes.insert(children_nodes.end(), local_children.begin(), local_children.end());
+        for (auto* child : local_children) {
+            children_nodes.push_back(child);
+        }
     }
 
     return children_nodes;
 }
 
-std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& universe, BoundingBox& BB, std::vector<std::int32_t>& body_indices) {
+QuadtreeNodeChildren Quadtree::construct_task_with_cutoff(Universe& universe, BoundingBox& BB, std::vector<std::int32_t>& body_indices) {
   const int cutoff = 125000;
   // Basisfall: Kein Körper im Bereich
     if (body_indices.empty()) {
@@ -195,7 +265,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
     }
 	// Basisfall: Genau ein Körper -> Blattknoten
     if (body_indices.size() == 1) {
-        QuadtreeNode* leaf_node = new QuadtreeNode(BB);
+        QuadtreeNode* leaf_node = node_arena.allocate(BB);
         int body_index = body_indices[0];
         leaf_node->body_identifier = body_index;
         leaf_node->cumulative_mass = universe.weights[body_index];
@@ -215,7 +285,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
     const BoundingBox Q4 = BoundingBox(xmid, BB.x_max, BB.y_min ,ymid);
     std::vector<BoundingBox> sub_boxes = {Q1, Q2, Q3, Q4};
 
-    std::vector<QuadtreeNode*> children_nodes;
+    QuadtreeNodeChildren children_nodes;
 
 	#pragma omp parallel
    	 {
@@ -234,7 +304,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
                 // Fall 1: Wenige Körper -> Serielle Konstruktion
                 if (!sub_indices.empty() && sub_indices.size() <= cutoff) {
                   	if (sub_indices.size() == 1) {
-                        QuadtreeNode* leaf_node = new QuadtreeNode(sub_box);
+                        QuadtreeNode* leaf_node = node_arena.allocate(sub_box);
                         int body_index = sub_indices[0];
                         leaf_node->body_identifier = body_index;
                         leaf_node->cumulative_mass = universe.weights[body_index];
@@ -246,7 +316,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
                         children_nodes.push_back(leaf_node);
                     }else {
 
-                    	QuadtreeNode* child_node = new QuadtreeNode(sub_box);
+                    	QuadtreeNode* child_node = node_arena.allocate(sub_box);
                     	auto sub_children = construct(universe, sub_box, sub_indices);
                     	child_node->children = sub_children;
 
@@ -260,7 +330,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
                     #pragma omp task shared(children_nodes)
                     {
                       if (sub_indices.size() == 1) {
-                        QuadtreeNode* leaf_node = new QuadtreeNode(sub_box);
+                        QuadtreeNode* leaf_node = node_arena.allocate(sub_box);
                         int body_index = sub_indices[0];
                         leaf_node->body_identifier = body_index;
                        	leaf_node->cumulative_mass = universe.weights[body_index];
@@ -272,7 +342,7 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
                         children_nodes.push_back(leaf_node);
                         } else {
 
-                        QuadtreeNode* child_node = new QuadtreeNode(sub_box);
+                        QuadtreeNode* child_node = node_arena.allocate(sub_box);
                         auto sub_children = construct_task_with_cutoff(universe, sub_box, sub_indices);
                         child_node->children = sub_children;
 
@@ -290,6 +360,190 @@ std::vector<QuadtreeNode*> Quadtree::construct_task_with_cutoff(Universe& univer
     return children_nodes;
   }
 
+// sorts the range by quadrant (ids of BoundingBox::get_quadrant) with a single classification per body.
+// the quadrant ranges are [bounds[q], bounds[q + 1]), bodies on a boundary belong to exactly one quadrant
+static std::array<std::int32_t, 5> partition_quadrants(Universe& universe, const BoundingBox& BB, std::int32_t* body_indices, std::uint8_t* quadrant_codes, std::int32_t count) {
+    double xmid = BB.x_min + (BB.x_max - BB.x_min)/2;
+    double ymid = BB.y_min + (BB.y_max - BB.y_min)/2;
+
+    std::array<std::int32_t, 4> counts = {0, 0, 0, 0};
+    for (std::int32_t i = 0; i < count; i++) {
+        const Vector2d<double>& position = universe.positions[body_indices[i]];
+        std::uint8_t code = (position[0] > xmid ? 1 : 0) + (position[1] < ymid ? 2 : 0);
+        quadrant_codes[i] = code;
+        counts[code]++;
+    }
+
+    std::array<std::int32_t, 5> bounds;
+    bounds[0] = 0;
+    for (std::int32_t q = 0; q < 4; q++) {
+        bounds[q + 1] = bounds[q] + counts[q];
+    }
+
+    // in place permutation: swap every misplaced body into the next free slot of its quadrant
+    std::array<std::int32_t, 4> next = {bounds[0], bounds[1], bounds[2], bounds[3]};
+    for (std::int32_t q = 0; q < 4; q++) {
+        while (next[q] < bounds[q + 1]) {
+            std::uint8_t code = quadrant_codes[next[q]];
+            if (code == q) {
+                next[q]++;
+                continue;
+            }
+            std::swap(body_indices[next[q]], body_indices[next[code]]);
+            std::swap(quadrant_codes[next[q]], quadrant_codes[next[code]]);
+            next[code]++;
+        }
+    }
+    return bounds;
+}
+
+QuadtreeNodeChildren Quadtree::construct_partitioned(Universe& universe, BoundingBox BB, std::int32_t* body_indices, std::uint8_t* quadrant_codes, std::int32_t count, bool with_moments) {
+    if (count == 0) {
+        return {};
+    }
+    if (count == 1) {
+        return {create_leaf(node_arena, universe, BB, body_indices[0], nullptr)};
+    }
+
+    std::array<std::int32_t, 5> bounds = partition_quadrants(universe, BB, body_indices, quadrant_codes, count);
+
+    QuadtreeNodeChildren children_nodes;
+    for (std::uint8_t q = 0; q < 4; q++) {
+        std::int32_t sub_count = bounds[q + 1] - bounds[q];
+        if (sub_count == 0) {
+            continue;
+        }
+        BoundingBox sub_box = BB.get_quadrant(q);
+        if (sub_count == 1) {
+            children_nodes.push_back(create_leaf(node_arena, universe, sub_box, body_indices[bounds[q]], nullptr));
+        } else {
+            QuadtreeNode* child_node = node_arena.allocate(sub_box);
+            child_node->children = construct_partitioned(universe, sub_box, body_indices + bounds[q], quadrant_codes + bounds[q], sub_count, with_moments);
+            if (with_moments) {
+                child_node->aggregate_children();
+            }
+            children_nodes.push_back(child_node);
+        }
+    }
+    return children_nodes;
+}
+
+std::int32_t Quadtree::adaptive_task_cutoff(std::int32_t num_bodies, std::int32_t num_threads) {
+    // about 16 tasks per thread for load balancing, but no tasks for subtrees that are built in a few microseconds
+    const std::int32_t min_cutoff = 2048;
+    return std::max(min_cutoff, num_bodies / (16 * std::max(num_threads, 1)));
+}
+
+void Quadtree::construct_adaptive(Universe& universe, QuadtreeNode* node, std::int32_t* body_indices, std::uint8_t* quadrant_codes, std::int32_t count, std::int32_t task_cutoff, bool with_moments) {
+    if (count <= task_cutoff) {
+        node->children = construct_partitioned(universe, node->bounding_box, body_indices, quadrant_codes, count, with_moments);
+        if (with_moments) {
+            node->aggregate_children();
+        }
+        return;
+    }
+
+    std::array<std::int32_t, 5> bounds = partition_quadrants(universe, node->bounding_box, body_indices, quadrant_codes, count);
+
+    // the children slots are only written by this task, every child task fills the slots of its own node
+    for (std::uint8_t q = 0; q < 4; q++) {
+        std::int32_t sub_count = bounds[q + 1] - bounds[q];
+        if (sub_count == 0) {
+            continue;
+        }
+        BoundingBox sub_box = node->bounding_box.get_quadrant(q);
+        if (sub_count == 1) {
+            node->children.push_back(create_leaf(node_arena, universe, sub_box, body_indices[bounds[q]], nullptr));
+            continue;
+        }
+        QuadtreeNode* child_node = node_arena.allocate(sub_box);
+        node->children.push_back(child_node);
+        std::int32_t* sub_indices = body_indices + bounds[q];
+        std::uint8_t* sub_codes = quadrant_codes + bounds[q];
+        #pragma omp task shared(universe) firstprivate(child_node, sub_indices, sub_codes, sub_count)
+        construct_adaptive(universe, child_node, sub_indices, sub_codes, sub_count, task_cutoff, with_moments);
+    }
+    if (with_moments) {
+        // the moments of the children are complete once their tasks are
+        #pragma omp taskwait
+        node->aggregate_children();
+    }
+}
+
+// squared distance between the position and the closest point of the box
+static double squared_box_distance(const BoundingBox& box, const Vector2d<double>& position) {
+    double dx = std::max({box.x_min - position[0], 0.0, position[0] - box.x_max});
+    double dy = std::max({box.y_min - position[1], 0.0, position[1] - box.y_max});
+    return dx * dx + dy * dy;
+}
+
+void Quadtree::query_radius(Universe& universe, const Vector2d<double>& position, double radius, std::vector<std::int32_t>& bodies) const {
+    const double squared_radius = radius * radius;
+    auto within_radius = [&](std::int32_t body_index) {
+        Vector2d<double> connect = universe.positions[body_index] - position;
+        return connect.norm() < radius;
+    };
+
+    if (is_linear()) {
+        thread_local std::vector<std::int32_t> stack;
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            const LinearQuadtreeNode& node = linear_quadtree.nodes[stack.back()];
+            stack.pop_back();
+            if (squared_box_distance(node.bounding_box, position) >= squared_radius) continue;
+            if (node.is_leaf()) {
+                for (std::int32_t k = node.first_body; k < node.first_body + node.body_count; k++) {
+                    if (within_radius(linear_quadtree.body_indices[k])) {
+                        bodies.push_back(linear_quadtree.body_indices[k]);
+                    }
+                }
+                continue;
+            }
+            for (std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++) {
+                stack.push_back(c);
+            }
+        }
+        return;
+    }
+
+    // reused across the queries of a thread
+    thread_local std::vector<const QuadtreeNode*> stack;
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        const QuadtreeNode* node = stack.back();
+        stack.pop_back();
+        if (squared_box_distance(node->bounding_box, position) >= squared_radius) continue;
+        if (node->body_identifier != -1) {
+            if (within_radius(node->body_identifier)) {
+                bodies.push_back(node->body_identifier);
+            }
+            continue;
+        }
+        for (const QuadtreeNode* child : node->children) {
+            stack.push_back(child);
+        }
+    }
+}
+
+std::vector<std::int32_t> Quadtree::bodies_in_tree_order() const {
+    if (is_linear()) {
+        return linear_quadtree.body_indices;
+    }
+    std::vector<std::int32_t> bodies;
+    std::vector<const QuadtreeNode*> stack = {root};
+    while (!stack.empty()) {
+        const QuadtreeNode* node = stack.back();
+        stack.pop_back();
+        if (node->body_identifier != -1) {
+            bodies.push_back(node->body_identifier);
+        }
+        for (auto child = node->children.rbegin(); child != node->children.rend(); ++child) {
+            stack.push_back(*child);
+        }
+    }
+    return bodies;
+}
+
 std::vector<BoundingBox> Quadtree::get_bounding_boxes(QuadtreeNode* qtn) {
     // traverse quadtree and collect bounding boxes
     std::vector<BoundingBox> result;
@@ -303,10 +557,149 @@ std::vector<BoundingBox> Quadtree::get_bounding_boxes(QuadtreeNode* qtn) {
     return result;
 }
 
+void Quadtree::link_nodes(std::size_t num_bodies) {
+    body_leaves.assign(num_bodies, nullptr);
+    depth = 0;
+
+    // iterative traversal, the trees can be deep
+    std::vector<std::pair<QuadtreeNode*, std::int32_t>> stack = {{root, 0}};
+    while(!stack.empty()) {
+        auto [node, node_depth] = stack.back();
+        stack.pop_back();
+        depth = std::max(depth, node_depth);
+        if(node->body_identifier != -1 && node->body_identifier < static_cast<std::int32_t>(num_bodies)) {
+            body_leaves[node->body_identifier] = node;
+        }
+        for(auto* child : node->children) {
+            child->parent = node;
+            stack.emplace_back(child, node_depth + 1);
+        }
+    }
+    constructed_depth = depth;
+}
+
+void Quadtree::mark_dirty(QuadtreeNode* node) {
+    // stop at the first node that is already dirty, its ancestors are dirty as well
+    while(node != nullptr && (node->cumulative_mass_ready || node->center_of_mass_ready || node->quadrupole_ready)) {
+        node->cumulative_mass_ready = false;
+        node->center_of_mass_ready = false;
+        node->quadrupole_ready = false;
+        node = node->parent;
+    }
+}
+
+void Quadtree::remove_body(std::int32_t body_index) {
+    QuadtreeNode* node = body_leaves[body_index];
+    body_leaves[body_index] = nullptr;
+
+    // unlink the leaf and all ancestors that become empty, their storage stays in the arena until the tree is destroyed
+    while(node != root && node->children.empty()) {
+        QuadtreeNode* parent = node->parent;
+        parent->children.erase(std::find(parent->children.begin(), parent->children.end(), node));
+        node = parent;
+    }
+    mark_dirty(node);
+}
+
+
+// quadrant of the box that contains the position, same ids as BoundingBox::get_quadrant
+static BoundingBox containing_quadrant(BoundingBox BB, const Vector2d<double>& position) {
+    double xmid = BB.x_min + (BB.x_max - BB.x_min)/2;
+    double ymid = BB.y_min + (BB.y_max - BB.y_min)/2;
+    std::uint8_t quadrant_id = (position[0] <= xmid ? 0 : 1) + (position[1] >= ymid ? 0 : 2);
+    return BB.get_quadrant(quadrant_id);
+}
 
+bool Quadtree::insert_body(Universe& universe, std::int32_t body_index) {
+    // identical positions would be split forever
+    const std::int32_t max_depth = constructed_depth + 64;
+    const Vector2d<double>& position = universe.positions[body_index];
+    QuadtreeNode* node = root;
+    std::int32_t node_depth = 0;
+
+    while(node_depth < max_depth) {
+        QuadtreeNode* next = nullptr;
+        for(auto* child : node->children) {
+            if(child->bounding_box.contains(position)) {
+                next = child;
+                break;
+            }
+        }
 
+        if(next == nullptr) {
+            // empty quadrant: new leaf
+            QuadtreeNode* leaf_node = create_leaf(node_arena, universe, containing_quadrant(node->bounding_box, position), body_index, node);
+            node->children.push_back(leaf_node);
+            body_leaves[body_index] = leaf_node;
+            depth = std::max(depth, node_depth + 1);
+            mark_dirty(node);
+            return true;
+        }
 
+        if(next->body_identifier != -1) {
+            // occupied leaf becomes an inner node, its body moves one level down
+            std::int32_t other_body = next->body_identifier;
+            QuadtreeNode* other_leaf = create_leaf(node_arena, universe, containing_quadrant(next->bounding_box, universe.positions[other_body]), other_body, next);
+            next->body_identifier = -1;
+            next->children.push_back(other_leaf);
+            body_leaves[other_body] = other_leaf;
+            mark_dirty(next);
+        }
+        node = next;
+        node_depth++;
+    }
+    return false;
+}
 
+bool Quadtree::refit(Universe& universe, double max_moved_fraction, std::int32_t max_extra_depth) {
+    if(is_linear() || root == nullptr) {
+        return false;
+    }
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    if(body_leaves.size() != universe.num_bodies) {
+        link_nodes(universe.num_bodies);
+    }
 
+    // bodies that left their leaf
+    std::vector<char> moved(num_bodies, 0);
+    std::int32_t num_moved = 0;
+    bool outside_root = false;
+    #pragma omp parallel for reduction(+:num_moved) reduction(||:outside_root)
+    for(std::int32_t i = 0; i < num_bodies; i++) {
+        if(!root->bounding_box.contains(universe.positions[i])) {
+            outside_root = true;
+        }
+        if(body_leaves[i] == nullptr || !body_leaves[i]->bounding_box.contains(universe.positions[i])) {
+            moved[i] = 1;
+            num_moved++;
+        }
+    }
+    if(outside_root || num_moved > max_moved_fraction * num_bodies) {
+        return false;
+    }
 
+    for(std::int32_t i = 0; i < num_bodies; i++) {
+        if(moved[i] && body_leaves[i] != nullptr) {
+            remove_body(i);
+        }
+    }
+    for(std::int32_t i = 0; i < num_bodies; i++) {
+        if(moved[i]) {
+            if(!insert_body(universe, i)) return false;
+        }
+        else {
+            // body stayed in its leaf, the leaf follows the body
+            QuadtreeNode* leaf_node = body_leaves[i];
+            leaf_node->center_of_mass = universe.positions[i];
+            leaf_node->cumulative_mass = universe.weights[i];
+            mark_dirty(leaf_node->parent);
+        }
+    }
+    if(depth > constructed_depth + max_extra_depth) {
+        return false;
+    }
 
+    // recompute the dirty nodes bottom-up, clean subtrees return their cached values
+    calculate_moments();
+    return true;
+}
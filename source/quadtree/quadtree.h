@@ -3,19 +3,70 @@
 #include "structures/vector2d.h"
 #include "structures/universe.h"
 #include "quadtreeNode.h"
+#include "quadtreeNodeArena.h"
+#include "linearQuadtree.h"
 
 class Quadtree{
 public: 
-    Quadtree(Universe& universe, BoundingBox bounding_box, std::int8_t construct_mode);
+    // max_leaf_size is only used by the linear quadtree (construct_mode 3), larger leaves hold buckets of bodies
+    Quadtree(Universe& universe, BoundingBox bounding_box, std::int8_t construct_mode, std::uint32_t max_leaf_size = 1);
+    // structure-of-arrays universes are always stored in a linear quadtree
+    Quadtree(UniverseSoA& universe, BoundingBox bounding_box, std::uint32_t max_leaf_size = 1);
     ~Quadtree();
 
-    std::vector<QuadtreeNode*> construct(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices);
-    std::vector<QuadtreeNode*> construct_task(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices);
-    std::vector<QuadtreeNode*> construct_task_with_cutoff(Universe& universe, BoundingBox& BB, std::vector<std::int32_t>& body_indices);
+    QuadtreeNodeChildren construct(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices);
+    QuadtreeNodeChildren construct_task(Universe& universe, BoundingBox BB, std::vector<std::int32_t> body_indices);
+    QuadtreeNodeChildren construct_task_with_cutoff(Universe& universe, BoundingBox& BB, std::vector<std::int32_t>& body_indices);
+    // construct_mode 4: every body is classified once per level and body_indices is partitioned in place,
+    // the recursion works on subranges of one index buffer. quadrant_codes is scratch space of the same length
+    // with_moments: every built node gets its mass and center of mass on the way back (construct_mode 6)
+    QuadtreeNodeChildren construct_partitioned(Universe& universe, BoundingBox BB, std::int32_t* body_indices, std::uint8_t* quadrant_codes, std::int32_t count, bool with_moments = false);
+    // construct_mode 5: like construct_mode 4 inside one parallel region, subtrees with more than task_cutoff bodies
+    // are built by tasks that write the children of their own node without locking
+    // construct_mode 6: construct_mode 5 with_moments, the moments are ready when the construction returns
+    void construct_adaptive(Universe& universe, QuadtreeNode* node, std::int32_t* body_indices, std::uint8_t* quadrant_codes, std::int32_t count, std::int32_t task_cutoff, bool with_moments = false);
+    static std::int32_t adaptive_task_cutoff(std::int32_t num_bodies, std::int32_t num_threads);
+    // task cutoff of construct_mode 5, 0 -> adaptive_task_cutoff
+    static inline std::int32_t construct_task_cutoff = 0;
 
     void calculate_cumulative_masses();
     void calculate_center_of_mass();
+    // cumulative masses and centers of mass in one parallel pass, replaces the two calls above
+    void calculate_moments();
+    // optional, needed for multipole order 2
+    void calculate_quadrupole_moments();
     QuadtreeNode* root = nullptr;
+    // storage of all nodes of the pointer quadtree, released together with the tree
+    QuadtreeNodeArena node_arena;
+
+    // filled by construct_mode 3 (linear quadtree), root then stays nullptr
+    LinearQuadtree linear_quadtree;
+    [[nodiscard]] bool is_linear() const {
+        return !linear_quadtree.empty();
+    }
 
     std::vector<BoundingBox> get_bounding_boxes(QuadtreeNode* qtn);
+
+    // appends all bodies with a distance smaller than radius to position, subtrees whose bounding box is farther away are skipped.
+    // works on both tree types, the tree has to match the current positions of the universe
+    void query_radius(Universe& universe, const Vector2d<double>& position, double radius, std::vector<std::int32_t>& bodies) const;
+    // body indices in depth-first order of the leaves, neighbouring queries in this order visit the same nodes
+    std::vector<std::int32_t> bodies_in_tree_order() const;
+
+    // incremental update of the pointer quadtree (construct modes 0-2) after the bodies moved:
+    // bodies that left the bounding box of their leaf are reinserted, the moments are recomputed along the changed paths.
+    // returns false if the tree has to be rebuilt: a body left the root box, more than max_moved_fraction of the bodies
+    // moved or the tree got more than max_extra_depth levels deeper than after construction
+    bool refit(Universe& universe, double max_moved_fraction, std::int32_t max_extra_depth);
+    // parent pointers, leaf of every body and depth, called by refit if necessary
+    void link_nodes(std::size_t num_bodies);
+
+    std::vector<QuadtreeNode*> body_leaves;
+    std::int32_t depth = 0;
+    std::int32_t constructed_depth = 0;
+
+private:
+    void remove_body(std::int32_t body_index);
+    bool insert_body(Universe& universe, std::int32_t body_index);
+    void mark_dirty(QuadtreeNode* node);
 };
\ No newline at end of file
@@ -23,19 +23,11 @@ QuadtreeNode::QuadtreeNode(BoundingBox arg_bounding_box)
 		body_identifier(-1),
         cumulative_mass(0.0),
         center_of_mass_ready(false),
-		cumulative_mass_ready(false){
-      children = {};
+		cumulative_mass_ready(false),
+        diagonal(arg_bounding_box.get_diagonal()){
        // Standardinitialisierung der Felder
 }
 
-QuadtreeNode::~QuadtreeNode(){
-        // Speicher der Unterknoten freigeben
-        for (auto* child : children) {
-            delete child; // Dynamischen Speicher freigeben
-        }
-        children.clear(); // Sicherstellen, dass keine ungültigen Zeiger verbleiben
-}
-
 Vector2d<double> QuadtreeNode::calculate_node_center_of_mass(){
     if (center_of_mass_ready) return center_of_mass;
 
@@ -61,4 +53,64 @@ Vector2d<double> QuadtreeNode::calculate_node_center_of_mass(){
 
     center_of_mass_ready = true;
     return center_of_mass;
-}
\ No newline at end of file
+}
+
+void QuadtreeNode::calculate_node_moments(std::int32_t task_depth){
+    if (cumulative_mass_ready && center_of_mass_ready) return;
+
+    if (children.empty()) { // Blattknoten
+        cumulative_mass_ready = true;
+        center_of_mass_ready = true;
+        return;
+    }
+
+    if (task_depth > 0) {
+        for (auto* child : children) {
+            #pragma omp task firstprivate(child)
+            child->calculate_node_moments(task_depth - 1);
+        }
+        #pragma omp taskwait
+    } else {
+        for (auto* child : children) {
+            child->calculate_node_moments(0);
+        }
+    }
+
+    aggregate_children();
+}
+
+void QuadtreeNode::aggregate_children(){
+    Vector2d<double> total_center(0.0, 0.0);
+    cumulative_mass = 0.0;
+    for (auto* child : children) {
+        total_center = total_center + (child->center_of_mass * child->cumulative_mass);
+        cumulative_mass += child->cumulative_mass;
+    }
+    if (cumulative_mass > 0) {
+        center_of_mass = total_center / cumulative_mass;
+    }
+    cumulative_mass_ready = true;
+    center_of_mass_ready = true;
+}
+
+void QuadtreeNode::calculate_node_quadrupole(){
+    if (quadrupole_ready) return;
+
+    quadrupole_xx = 0.0;
+    quadrupole_xy = 0.0;
+    quadrupole_yy = 0.0;
+
+    // Blattknoten: einzelner Körper im Schwerpunkt hat kein Quadrupolmoment
+    for (auto* child : children) {
+        child->calculate_node_quadrupole();
+
+        // shift the child moment to the center of mass of this node
+        double sx = child->center_of_mass[0] - center_of_mass[0];
+        double sy = child->center_of_mass[1] - center_of_mass[1];
+        double m = child->cumulative_mass;
+        quadrupole_xx += child->quadrupole_xx + m * (2 * sx * sx - sy * sy);
+        quadrupole_yy += child->quadrupole_yy + m * (2 * sy * sy - sx * sx);
+        quadrupole_xy += child->quadrupole_xy + m * 3 * sx * sy;
+    }
+    quadrupole_ready = true;
+}
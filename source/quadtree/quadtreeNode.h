@@ -1,22 +1,85 @@
 #pragma once
 
-#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
 #include "structures/vector2d.h"
 #include "structures/bounding_box.h"
 
+class QuadtreeNode;
+
+// the at most four children of a node, stored inline instead of in a heap allocated vector
+class QuadtreeNodeChildren{
+public:
+    using iterator = QuadtreeNode**;
+    using const_iterator = QuadtreeNode* const*;
+
+    QuadtreeNodeChildren() = default;
+    QuadtreeNodeChildren(std::initializer_list<QuadtreeNode*> nodes) {
+        for(auto* node : nodes) {
+            push_back(node);
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    QuadtreeNode*& operator[](std::size_t index) { return slots[index]; }
+    QuadtreeNode* operator[](std::size_t index) const { return slots[index]; }
+
+    iterator begin() { return slots.data(); }
+    iterator end() { return slots.data() + count; }
+    const_iterator begin() const { return slots.data(); }
+    const_iterator end() const { return slots.data() + count; }
+    std::reverse_iterator<const_iterator> rbegin() const { return std::reverse_iterator<const_iterator>(end()); }
+    std::reverse_iterator<const_iterator> rend() const { return std::reverse_iterator<const_iterator>(begin()); }
+
+    void push_back(QuadtreeNode* child) { slots[count++] = child; }
+    // keeps the order of the remaining children
+    void erase(const_iterator position) {
+        for(std::size_t i = position - slots.data(); i + 1 < count; i++) {
+            slots[i] = slots[i + 1];
+        }
+        count--;
+    }
+    void clear() { count = 0; }
+
+private:
+    std::array<QuadtreeNode*, 4> slots{};
+    std::uint8_t count = 0;
+};
+
+// nodes of the pointer quadtree live in the QuadtreeNodeArena of their Quadtree and are never deleted individually
 class QuadtreeNode{
 public:
     QuadtreeNode(BoundingBox arg_bounding_box);
-    ~QuadtreeNode();
     double calculate_node_cumulative_mass();
     Vector2d<double> calculate_node_center_of_mass();
-    std::vector<QuadtreeNode*> children;    
+    // requires center of mass and cumulative mass of the subtree
+    void calculate_node_quadrupole();
+    // cumulative mass and center of mass of the subtree in one pass, every child is visited once.
+    // the first task_depth levels below this node are processed by OpenMP tasks, call inside a parallel region
+    void calculate_node_moments(std::int32_t task_depth);
+    // mass and center of mass from the (ready) moments of the children
+    void aggregate_children();
+    QuadtreeNodeChildren children;
+    // only set by Quadtree::link_nodes, used by the incremental refit
+    QuadtreeNode* parent = nullptr;
     Vector2d<double> center_of_mass;
     double cumulative_mass;
     std::int32_t body_identifier = -1;
 
+    // traceless quadrupole around center_of_mass: Q_ij = sum m (3 s_i s_j - |s|^2 delta_ij)
+    double quadrupole_xx = 0.0;
+    double quadrupole_xy = 0.0;
+    double quadrupole_yy = 0.0;
+
     bool center_of_mass_ready = false;
     bool cumulative_mass_ready = false;
+    bool quadrupole_ready = false;
 
     BoundingBox bounding_box;
+    // cached bounding_box.get_diagonal(), the box does not change after construction
+    double diagonal;
 };
\ No newline at end of file
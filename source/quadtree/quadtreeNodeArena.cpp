@@ -0,0 +1,57 @@
+#include "quadtreeNodeArena.h"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+// the arena only releases memory, it never runs destructors
+static_assert(std::is_trivially_destructible_v<QuadtreeNode>);
+
+namespace {
+    std::atomic<std::uint64_t> arena_counter{0};
+
+    // current block of this thread, only valid for the arena with the matching id
+    struct ArenaCursor{
+        std::uint64_t arena_id = 0;
+        QuadtreeNode* next = nullptr;
+        QuadtreeNode* end = nullptr;
+    };
+    thread_local ArenaCursor arena_cursor;
+}
+
+QuadtreeNodeArena::QuadtreeNodeArena() : arena_id(++arena_counter) {}
+
+QuadtreeNodeArena::~QuadtreeNodeArena() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for(auto& block : blocks) {
+        block_pool.push_back(std::move(block));
+    }
+}
+
+QuadtreeNode* QuadtreeNodeArena::allocate(BoundingBox bounding_box) {
+    if(arena_cursor.arena_id != arena_id || arena_cursor.next == arena_cursor.end) {
+        QuadtreeNode* block_begin = next_block();
+        arena_cursor = {arena_id, block_begin, block_begin + nodes_per_block};
+    }
+    return new (arena_cursor.next++) QuadtreeNode(bounding_box);
+}
+
+QuadtreeNode* QuadtreeNodeArena::next_block() {
+    std::unique_ptr<Block> block;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if(!block_pool.empty()) {
+            block = std::move(block_pool.back());
+            block_pool.pop_back();
+        }
+    }
+    if(!block) {
+        // default initialized, the nodes are constructed on allocation
+        block.reset(new Block);
+    }
+    QuadtreeNode* block_begin = reinterpret_cast<QuadtreeNode*>(block->storage);
+
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    blocks.push_back(std::move(block));
+    return block_begin;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "quadtreeNode.h"
+
+// bump allocator for the nodes of one pointer quadtree. every thread allocates from its own block,
+// so the tasks of the parallel construction do not contend on the global allocator.
+// nodes are not freed individually, the blocks are handed to a shared pool when the arena is destroyed
+// and reused by the tree of the next epoch
+class QuadtreeNodeArena{
+public:
+    QuadtreeNodeArena();
+    ~QuadtreeNodeArena();
+    QuadtreeNodeArena(const QuadtreeNodeArena&) = delete;
+    QuadtreeNodeArena& operator=(const QuadtreeNodeArena&) = delete;
+
+    // thread safe
+    QuadtreeNode* allocate(BoundingBox bounding_box);
+
+    static constexpr std::size_t nodes_per_block = 1024;
+
+private:
+    struct Block{
+        alignas(QuadtreeNode) std::byte storage[nodes_per_block * sizeof(QuadtreeNode)];
+    };
+
+    QuadtreeNode* next_block();
+
+    // distinguishes the arenas in the cursors of the threads
+    const std::uint64_t arena_id;
+    std::mutex blocks_mutex;
+    std::vector<std::unique_ptr<Block>> blocks;
+
+    static inline std::mutex pool_mutex;
+    static inline std::vector<std::unique_ptr<Block>> block_pool;
+};
@@ -2,33 +2,135 @@
 #include "simulation/naive_parallel_simulation.h"
 #include "physics/gravitation.h"
 #include "physics/mechanics.h"
+#include "quadtree/morton.h"
+#include "simulation/integrator.h"
 #include "omp.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 void BarnesHutSimulation::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    if(fused_epoch && Integrator::integrator == IntegratorType::euler) {
+        // every fused epoch delivers the bounding box for the next one
+        std::unique_ptr<Quadtree> quadtree;
+        BoundingBox bounding_box = universe.get_bounding_box();
+        for(int i = 0; i < num_epochs; i++){
+            simulate_epoch(plotter, universe, quadtree, bounding_box, create_intermediate_plots, plot_intermediate_epochs);
+        }
+        return;
+    }
+    // the refit only works on the pointer quadtree
+    if(incremental_tree && !uses_bucket_traversal() && construct_mode != 3) {
+        std::unique_ptr<Quadtree> quadtree;
+        for(int i = 0; i < num_epochs; i++){
+            simulate_epoch(plotter, universe, quadtree, create_intermediate_plots, plot_intermediate_epochs);
+        }
+        return;
+    }
     for(int i = 0; i < num_epochs; i++){
         simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
     }
 }
 
 void BarnesHutSimulation::simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
-    Quadtree qt = Quadtree(universe, universe.get_bounding_box(), 2);   //construct mode ????
+    if(fused_epoch && Integrator::integrator == IntegratorType::euler) {
+        std::unique_ptr<Quadtree> quadtree;
+        BoundingBox bounding_box = universe.get_bounding_box();
+        simulate_epoch(plotter, universe, quadtree, bounding_box, create_intermediate_plots, plot_intermediate_epochs);
+        return;
+    }
+    // the bucket traversal needs a linear quadtree with bucket leaves
+    std::int8_t tree_construct_mode = uses_bucket_traversal() ? 3 : construct_mode;
+    std::uint32_t max_leaf_size = uses_bucket_traversal() ? bucket_size : 1;
+    reorder_bodies(universe);
+    Integrator::step(universe, [&](Universe& u){
+        Quadtree qt = Quadtree(u, u.get_bounding_box(), tree_construct_mode, max_leaf_size);
+        qt.calculate_moments();
+        calculate_forces(u, qt);
+    });
 
-    qt.calculate_center_of_mass();
-    qt.calculate_cumulative_masses();
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.write_and_clear();
+    }
 
-    calculate_forces(universe, qt);
+}
 
-    NaiveParallelSimulation::calculate_velocities(universe);
-    NaiveParallelSimulation::calculate_positions(universe);
+void BarnesHutSimulation::simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    // the leaves of the kept tree refer to the old slots
+    if(reorder_bodies(universe)) {
+        quadtree.reset();
+    }
+    Integrator::step(universe, [&](Universe& u){
+        update_quadtree(u, quadtree);
+        calculate_forces(u, *quadtree);
+    });
+
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.write_and_clear();
+    }
+}
 
+void BarnesHutSimulation::simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, BoundingBox& bounding_box, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    // the permutation keeps the bounding box, but the leaves of a kept tree refer to the old slots
+    if(reorder_bodies(universe)) {
+        quadtree.reset();
+    }
+    update_fused_quadtree(universe, quadtree, bounding_box);
+    bounding_box = calculate_forces_fused(universe, *quadtree, Integrator::time_step);
 
     universe.current_simulation_epoch++;
     if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
         plotter.write_and_clear();
     }
+}
+
+void BarnesHutSimulation::update_fused_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree, const BoundingBox& bounding_box){
+    if(incremental_tree && !uses_bucket_traversal() && construct_mode != 3) {
+        update_quadtree(universe, quadtree, bounding_box);
+        return;
+    }
+    // the bucket traversal needs a linear quadtree with bucket leaves
+    std::int8_t tree_construct_mode = uses_bucket_traversal() ? 3 : construct_mode;
+    std::uint32_t max_leaf_size = uses_bucket_traversal() ? bucket_size : 1;
+    quadtree = std::make_unique<Quadtree>(universe, bounding_box, tree_construct_mode, max_leaf_size);
+    quadtree->calculate_moments();
+}
 
+bool BarnesHutSimulation::reorder_bodies(Universe& universe){
+    if(reorder_interval == 0 || universe.current_simulation_epoch % reorder_interval != 0) {
+        return false;
+    }
+    morton_reorder(universe);
+    return true;
+}
+
+void BarnesHutSimulation::update_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree){
+    if(quadtree && quadtree->refit(universe, refit_max_moved_fraction, refit_max_extra_depth)) {
+        tree_refits++;
+        return;
+    }
+    update_quadtree(universe, quadtree, universe.get_bounding_box());
+}
+
+void BarnesHutSimulation::update_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree, const BoundingBox& bounding_box){
+    if(quadtree && quadtree->refit(universe, refit_max_moved_fraction, refit_max_extra_depth)) {
+        tree_refits++;
+        return;
+    }
+
+    // padded root box, so that the tree survives a few epochs of moving bodies
+    BoundingBox bb = bounding_box;
+    double padding_x = (bb.x_max - bb.x_min) * refit_box_padding;
+    double padding_y = (bb.y_max - bb.y_min) * refit_box_padding;
+    bb = BoundingBox(bb.x_min - padding_x, bb.x_max + padding_x, bb.y_min - padding_y, bb.y_max + padding_y);
+
+    quadtree = std::make_unique<Quadtree>(universe, bb, construct_mode);
+    quadtree->calculate_moments();
+    quadtree->link_nodes(universe.num_bodies);
+    tree_rebuilds++;
 }
 
 void BarnesHutSimulation::get_relevant_nodes(Universe& universe, Quadtree& quadtree, std::vector<QuadtreeNode*>& relevant_nodes, Vector2d<double>& body_position, std::int32_t body_index, double threshold_theta){
@@ -62,22 +164,489 @@ void BarnesHutSimulation::get_relevant_nodes_recursive(QuadtreeNode* node, Unive
 }
 
 
+// quadrupole correction of the force on a body at offset (x, y) from the center of mass of a node
+static inline void add_quadrupole_force(double x, double y, double quadrupole_xx, double quadrupole_xy, double quadrupole_yy, double body_mass, double& fx, double& fy) {
+    double inverse_r_squared = 1.0 / (x * x + y * y);
+    double inverse_r = sqrt(inverse_r_squared);
+    double inverse_r5 = inverse_r_squared * inverse_r_squared * inverse_r;
+    double qx = quadrupole_xx * x + quadrupole_xy * y;
+    double qy = quadrupole_xy * x + quadrupole_yy * y;
+    double xqx = x * qx + y * qy;
+
+    // a = G * (Q x / r^5 - 5/2 * (x^T Q x) x / r^7)
+    double scale = gravitational_constant * body_mass * inverse_r5;
+    fx += scale * (qx - 2.5 * xqx * inverse_r_squared * x);
+    fy += scale * (qy - 2.5 * xqx * inverse_r_squared * y);
+}
+
+// force on body i from its relevant node list (force engine 0)
+static Vector2d<double> relevant_nodes_force(Universe& universe, Quadtree& quadtree, std::int32_t i, double theta, bool use_quadrupole) {
+    auto f = Vector2d<double>(0, 0);
+    //berechne alle für Körper relevanten nodes
+    auto relevant_nodes = std::vector<QuadtreeNode*>();
+    BarnesHutSimulation::get_relevant_nodes(universe, quadtree, relevant_nodes, universe.positions[i], i, theta);
+
+    //gehe durch alle relevanten Nodes und berechne Kraft auf Körper
+    for(const QuadtreeNode* node : relevant_nodes) {
+        Vector2d<double> bn = (node->center_of_mass - universe.positions[i]);
+        double r = sqrt(bn[0] * bn[0] + bn[1] * bn[1]);
+
+        f =  f + bn / r * gravitational_force(universe.weights[i], node->cumulative_mass, r);
+        if(use_quadrupole) {
+            double fx = 0.0;
+            double fy = 0.0;
+            add_quadrupole_force(-bn[0], -bn[1], node->quadrupole_xx, node->quadrupole_xy, node->quadrupole_yy, universe.weights[i], fx, fy);
+            f = f + Vector2d<double>(fx, fy);
+        }
+    }
+    return f;
+}
+
 void BarnesHutSimulation::calculate_forces(Universe& universe, Quadtree& quadtree) {
+    if(multipole_order >= 2) {
+        quadtree.calculate_quadrupole_moments();
+    }
+    if(quadtree.is_linear()) {
+        if(uses_bucket_traversal()) {
+            calculate_forces_grouped(universe, quadtree, threshold_theta);
+        }
+        else {
+            calculate_forces_linear(universe, quadtree, threshold_theta);
+        }
+        return;
+    }
+    if(force_engine != 0) {
+        calculate_forces_stack(universe, quadtree, threshold_theta);
+        return;
+    }
+
+    const double theta = threshold_theta;
+    const bool use_quadrupole = multipole_order >= 2;
+
     //gehe alle Körper durch
-#pragma omp parallel for default(none) shared(universe, quadtree)
+#pragma omp parallel for default(none) shared(universe, quadtree, theta, use_quadrupole)
     for(int i = 0; i < universe.num_bodies; i++) {
-        auto f = Vector2d<double>(0, 0);
-        //berechne alle für Körper relevanten nodes
-        auto relevant_nodes = std::vector<QuadtreeNode*>();
-        get_relevant_nodes(universe, quadtree, relevant_nodes, universe.positions[i], i, 0.2);
+        universe.forces[i] = relevant_nodes_force(universe, quadtree, i, theta, use_quadrupole);
+    }
+}
+
+// force of a single node on a body, same criterion as get_relevant_nodes_recursive
+struct NodeForceAccumulator {
+    double body_x;
+    double body_y;
+    double body_mass;
+    double theta_squared;
+    bool use_quadrupole;
+    // Gravitation::softening_length squared
+    double softening_squared;
+    double fx = 0.0;
+    double fy = 0.0;
+
+    // returns true if the children of the node have to be visited
+    bool visit(const QuadtreeNode* node) {
+        const BoundingBox& box = node->bounding_box;
+        bool contains_body = box.x_min <= body_x && body_x <= box.x_max && box.y_min <= body_y && body_y <= box.y_max;
+        double dx = node->center_of_mass[0] - body_x;
+        double dy = node->center_of_mass[1] - body_y;
+        double r_squared = dx * dx + dy * dy;
+
+        // d / r < theta  <=>  d^2 < theta^2 * r^2
+        bool accept = !contains_body && (node->diagonal * node->diagonal < theta_squared * r_squared || node->body_identifier != -1);
+        if(accept) {
+            // empty leaves carry no mass
+            if(node->cumulative_mass > 0) {
+                double softened_r_squared = r_squared + softening_squared;
+                double r = sqrt(softened_r_squared);
+                double f = gravitational_constant * body_mass * node->cumulative_mass / (softened_r_squared * r);
+                fx += dx * f;
+                fy += dy * f;
+                if(use_quadrupole) {
+                    add_quadrupole_force(-dx, -dy, node->quadrupole_xx, node->quadrupole_xy, node->quadrupole_yy, body_mass, fx, fy);
+                }
+            }
+            return false;
+        }
+        return node->body_identifier == -1 && !node->children.empty();
+    }
+};
+
+// fallback for trees that are deeper than the fixed stack
+static void accumulate_node_force_recursive(const QuadtreeNode* node, NodeForceAccumulator& accumulator) {
+    if(accumulator.visit(node)) {
+        for(const QuadtreeNode* child : node->children) {
+            if(child) accumulate_node_force_recursive(child, accumulator);
+        }
+    }
+}
 
-        //gehe durch alle relevanten Nodes und berechne Kraft auf Körper
-        for(const QuadtreeNode* node : relevant_nodes) {
-            Vector2d<double> bn = (universe.positions[i] - node->center_of_mass);
-            double r = sqrt(bn[0] * bn[0] + bn[1] * bn[1]);
+// force on body i with an explicit stack instead of the relevant node list
+static Vector2d<double> stack_traversal_force(Universe& universe, Quadtree& quadtree, std::int32_t i, double threshold_theta, bool use_quadrupole) {
+    constexpr std::int32_t stack_capacity = 256;
+    NodeForceAccumulator accumulator{universe.positions[i][0], universe.positions[i][1], universe.weights[i], threshold_theta * threshold_theta, use_quadrupole,
+                                     Gravitation::softening_squared()};
 
-            f =  f + bn / r * gravitational_force(universe.weights[i], node->cumulative_mass, r);
+    const QuadtreeNode* stack[stack_capacity];
+    std::int32_t stack_size = 0;
+    if(quadtree.root) stack[stack_size++] = quadtree.root;
+
+    while(stack_size > 0) {
+        const QuadtreeNode* node = stack[--stack_size];
+        if(!accumulator.visit(node)) continue;
+
+        if(stack_size + static_cast<std::int32_t>(node->children.size()) > stack_capacity) {
+            accumulate_node_force_recursive(node, accumulator);
+            continue;
+        }
+        // reverse order, so the children are visited in the same order as in get_relevant_nodes
+        for(auto child = node->children.rbegin(); child != node->children.rend(); ++child) {
+            if(*child) stack[stack_size++] = *child;
         }
-        universe.forces[i] = f;
     }
-}
\ No newline at end of file
+    return Vector2d<double>(accumulator.fx, accumulator.fy);
+}
+
+void BarnesHutSimulation::calculate_forces_stack(Universe& universe, Quadtree& quadtree, double threshold_theta) {
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int i = 0; i < universe.num_bodies; i++) {
+        universe.forces[i] = stack_traversal_force(universe, quadtree, i, threshold_theta, multipole_order >= 2);
+    }
+}
+
+void BarnesHutSimulation::calculate_forces(Universe& universe, Quadtree& quadtree, const std::vector<std::int32_t>& bodies) {
+    if(multipole_order >= 2) {
+        quadtree.calculate_quadrupole_moments();
+    }
+    const std::int64_t num_active = static_cast<std::int64_t>(bodies.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for(std::int64_t k = 0; k < num_active; k++) {
+        universe.forces[bodies[k]] = stack_traversal_force(universe, quadtree, bodies[k], threshold_theta, multipole_order >= 2);
+    }
+}
+
+// walks the linear quadtree once per body, store_force(body_index, fx, fy) receives the result
+template <typename StoreForce>
+static void linear_quadtree_forces(const LinearQuadtree& tree, double threshold_theta, bool use_quadrupole, StoreForce store_force) {
+    const std::int32_t num_bodies = static_cast<std::int32_t>(tree.body_indices.size());
+    const double theta_squared = threshold_theta * threshold_theta;
+
+    // iterate in Morton order, neighbouring iterations then walk nearly the same nodes
+#pragma omp parallel for schedule(dynamic, 64)
+    for(std::int32_t s = 0; s < num_bodies; s++) {
+        const double body_x = tree.body_x[s];
+        const double body_y = tree.body_y[s];
+        const double body_mass = tree.body_mass[s];
+        double fx = 0.0;
+        double fy = 0.0;
+
+        // depth is limited to 32 levels, each level adds at most 3 entries
+        std::int32_t stack[128];
+        std::int32_t stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while(stack_size > 0) {
+            const LinearQuadtreeNode& node = tree.nodes[stack[--stack_size]];
+            bool contains_body = s >= node.first_body && s < node.first_body + node.body_count;
+
+            if(!contains_body) {
+                double dx = node.center_of_mass_x - body_x;
+                double dy = node.center_of_mass_y - body_y;
+                double r_squared = dx * dx + dy * dy;
+                if(node.is_leaf() || node.diagonal * node.diagonal < theta_squared * r_squared) {
+                    double r = sqrt(r_squared);
+                    double f = gravitational_force(body_mass, node.cumulative_mass, r) / r;
+                    fx += dx * f;
+                    fy += dy * f;
+                    if(use_quadrupole) {
+                        add_quadrupole_force(-dx, -dy, node.quadrupole_xx, node.quadrupole_xy, node.quadrupole_yy, body_mass, fx, fy);
+                    }
+                    continue;
+                }
+            }
+            else if(node.is_leaf()) {
+                // bodies with identical keys share a leaf and interact directly
+                for(std::int32_t j = node.first_body; j < node.first_body + node.body_count; j++) {
+                    if(j == s) continue;
+                    double dx = tree.body_x[j] - body_x;
+                    double dy = tree.body_y[j] - body_y;
+                    double r = sqrt(dx * dx + dy * dy);
+                    double f = gravitational_force(body_mass, tree.body_mass[j], r) / r;
+                    fx += dx * f;
+                    fy += dy * f;
+                }
+                continue;
+            }
+
+            for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++) {
+                stack[stack_size++] = c;
+            }
+        }
+        store_force(tree.body_indices[s], fx, fy);
+    }
+}
+
+// sum of m_j * d / |d|^3 over the sources of a bucket. the body itself is in the list and masked out by its distance 0
+template <bool fast>
+static inline void bucket_source_sum(const double* sx, const double* sy, const double* sm, std::int32_t num_sources, double body_x, double body_y, double softening_squared, double& sum_x, double& sum_y) {
+#pragma omp simd reduction(+:sum_x, sum_y)
+    for(std::int32_t j = 0; j < num_sources; j++) {
+        double dx = sx[j] - body_x;
+        double dy = sy[j] - body_y;
+        double r_squared = dx * dx + dy * dy;
+        double inverse_r = inverse_distance<fast>(r_squared, softening_squared);
+        double f = sm[j] * inverse_r * inverse_r * inverse_r;
+        sum_x += dx * f;
+        sum_y += dy * f;
+    }
+}
+
+// walks the linear quadtree once per leaf (bucket of bodies) and applies the shared interaction list to all bodies of the bucket.
+// mixed_precision: the accepted nodes are evaluated in float, see BarnesHutSimulation::force_engine
+template <typename StoreForce>
+static void grouped_quadtree_forces(const LinearQuadtree& tree, double threshold_theta, bool use_quadrupole, bool mixed_precision, StoreForce store_force) {
+    const double theta_squared = threshold_theta * threshold_theta;
+    // float far field in units of the root diagonal and the total mass, so that neither r^3 nor the masses leave the float range
+    const double length_scale = !tree.nodes.empty() && tree.nodes[0].diagonal > 0 ? tree.nodes[0].diagonal : 1.0;
+    const double mass_scale = !tree.nodes.empty() && tree.nodes[0].cumulative_mass > 0 ? tree.nodes[0].cumulative_mass : 1.0;
+    const double inverse_length_scale = 1.0 / length_scale;
+    const double far_field_scale = mass_scale / (length_scale * length_scale);
+    const double softening_squared = Gravitation::softening_squared();
+    const float far_softening_squared = static_cast<float>(softening_squared * inverse_length_scale * inverse_length_scale);
+    const bool fast = Gravitation::fast_inverse_sqrt;
+
+    std::vector<std::int32_t> leaves;
+    for(std::int32_t k = 0; k < static_cast<std::int32_t>(tree.nodes.size()); k++) {
+        if(tree.nodes[k].is_leaf()) leaves.push_back(k);
+    }
+    const std::int32_t num_leaves = static_cast<std::int32_t>(leaves.size());
+
+#pragma omp parallel
+    {
+        // interaction lists, reused for all buckets of the thread
+        std::vector<double> source_x, source_y, source_mass;
+        std::vector<std::int32_t> quadrupole_nodes;
+        // accepted nodes of the mixed precision mode, offsets to the bucket center
+        std::vector<float> far_x, far_y, far_mass;
+
+#pragma omp for schedule(dynamic, 4)
+        for(std::int32_t l = 0; l < num_leaves; l++) {
+            const LinearQuadtreeNode& bucket = tree.nodes[leaves[l]];
+            const std::int32_t bucket_begin = bucket.first_body;
+            const std::int32_t bucket_end = bucket.first_body + bucket.body_count;
+
+            // tight box around the bodies of the bucket
+            double x_min = tree.body_x[bucket_begin], x_max = x_min;
+            double y_min = tree.body_y[bucket_begin], y_max = y_min;
+            for(std::int32_t s = bucket_begin + 1; s < bucket_end; s++) {
+                x_min = std::min(x_min, tree.body_x[s]);
+                x_max = std::max(x_max, tree.body_x[s]);
+                y_min = std::min(y_min, tree.body_y[s]);
+                y_max = std::max(y_max, tree.body_y[s]);
+            }
+
+            const double bucket_center_x = (x_min + x_max) / 2;
+            const double bucket_center_y = (y_min + y_max) / 2;
+
+            source_x.clear();
+            source_y.clear();
+            source_mass.clear();
+            quadrupole_nodes.clear();
+            far_x.clear();
+            far_y.clear();
+            far_mass.clear();
+
+            std::int32_t stack[128];
+            std::int32_t stack_size = 0;
+            stack[stack_size++] = 0;
+
+            while(stack_size > 0) {
+                const std::int32_t node_index = stack[--stack_size];
+                const LinearQuadtreeNode& node = tree.nodes[node_index];
+
+                // a node is accepted if the criterion holds for the closest point of the bucket box, nodes containing
+                // the bucket are always opened (with theta > 1 their center of mass can lie outside the bucket box)
+                bool contains_bucket = bucket_begin >= node.first_body && bucket_begin < node.first_body + node.body_count;
+                double dx = std::max({x_min - node.center_of_mass_x, 0.0, node.center_of_mass_x - x_max});
+                double dy = std::max({y_min - node.center_of_mass_y, 0.0, node.center_of_mass_y - y_max});
+                if(!contains_bucket && node.diagonal * node.diagonal < theta_squared * (dx * dx + dy * dy)) {
+                    if(mixed_precision) {
+                        // the offset is taken in double, only the short result is rounded to float
+                        far_x.push_back(static_cast<float>((node.center_of_mass_x - bucket_center_x) * inverse_length_scale));
+                        far_y.push_back(static_cast<float>((node.center_of_mass_y - bucket_center_y) * inverse_length_scale));
+                        far_mass.push_back(static_cast<float>(node.cumulative_mass / mass_scale));
+                    }
+                    else {
+                        source_x.push_back(node.center_of_mass_x);
+                        source_y.push_back(node.center_of_mass_y);
+                        source_mass.push_back(node.cumulative_mass);
+                    }
+                    if(use_quadrupole) quadrupole_nodes.push_back(node_index);
+                }
+                else if(node.is_leaf()) {
+                    // too close: the bodies of the leaf interact directly, including the bucket itself
+                    for(std::int32_t j = node.first_body; j < node.first_body + node.body_count; j++) {
+                        source_x.push_back(tree.body_x[j]);
+                        source_y.push_back(tree.body_y[j]);
+                        source_mass.push_back(tree.body_mass[j]);
+                    }
+                }
+                else {
+                    for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++) {
+                        stack[stack_size++] = c;
+                    }
+                }
+            }
+
+            const std::int32_t num_sources = static_cast<std::int32_t>(source_x.size());
+            const double* sx = source_x.data();
+            const double* sy = source_y.data();
+            const double* sm = source_mass.data();
+            const std::int32_t num_far = static_cast<std::int32_t>(far_x.size());
+            const float* far_px = far_x.data();
+            const float* far_py = far_y.data();
+            const float* far_m = far_mass.data();
+
+            for(std::int32_t s = bucket_begin; s < bucket_end; s++) {
+                const double body_x = tree.body_x[s];
+                const double body_y = tree.body_y[s];
+                double sum_x = 0.0;
+                double sum_y = 0.0;
+
+                if(fast) {
+                    bucket_source_sum<true>(sx, sy, sm, num_sources, body_x, body_y, softening_squared, sum_x, sum_y);
+                }
+                else {
+                    bucket_source_sum<false>(sx, sy, sm, num_sources, body_x, body_y, softening_squared, sum_x, sum_y);
+                }
+
+                if(num_far > 0) {
+                    // the body is close to the bucket center, its offset fits into a float
+                    const float offset_x = static_cast<float>((body_x - bucket_center_x) * inverse_length_scale);
+                    const float offset_y = static_cast<float>((body_y - bucket_center_y) * inverse_length_scale);
+                    double far_sum_x = 0.0;
+                    double far_sum_y = 0.0;
+                    // float partial sums over short blocks, the blocks are summed in double
+                    constexpr std::int32_t block_size = 64;
+                    for(std::int32_t block = 0; block < num_far; block += block_size) {
+                        const std::int32_t block_end = std::min(num_far, block + block_size);
+                        float block_sum_x = 0.0f;
+                        float block_sum_y = 0.0f;
+#pragma omp simd reduction(+:block_sum_x, block_sum_y)
+                        for(std::int32_t j = block; j < block_end; j++) {
+                            float dx = far_px[j] - offset_x;
+                            float dy = far_py[j] - offset_y;
+                            float inverse_r = 1.0f / std::sqrt(dx * dx + dy * dy + far_softening_squared);
+                            float f = far_m[j] * inverse_r * inverse_r * inverse_r;
+                            block_sum_x += dx * f;
+                            block_sum_y += dy * f;
+                        }
+                        far_sum_x += block_sum_x;
+                        far_sum_y += block_sum_y;
+                    }
+                    sum_x += far_sum_x * far_field_scale;
+                    sum_y += far_sum_y * far_field_scale;
+                }
+
+                const double body_mass = tree.body_mass[s];
+                double fx = gravitational_constant * body_mass * sum_x;
+                double fy = gravitational_constant * body_mass * sum_y;
+                for(std::int32_t node_index : quadrupole_nodes) {
+                    const LinearQuadtreeNode& node = tree.nodes[node_index];
+                    add_quadrupole_force(body_x - node.center_of_mass_x, body_y - node.center_of_mass_y, node.quadrupole_xx, node.quadrupole_xy, node.quadrupole_yy, body_mass, fx, fy);
+                }
+                store_force(tree.body_indices[s], fx, fy);
+            }
+        }
+    }
+}
+
+void BarnesHutSimulation::calculate_forces_grouped(Universe& universe, Quadtree& quadtree, double threshold_theta) {
+    grouped_quadtree_forces(quadtree.linear_quadtree, threshold_theta, multipole_order >= 2, force_engine == 3, [&](std::int32_t body_index, double fx, double fy) {
+        universe.forces[body_index] = Vector2d<double>(fx, fy);
+    });
+}
+
+void BarnesHutSimulation::calculate_forces_linear(Universe& universe, Quadtree& quadtree, double threshold_theta) {
+    linear_quadtree_forces(quadtree.linear_quadtree, threshold_theta, multipole_order >= 2, [&](std::int32_t body_index, double fx, double fy) {
+        universe.forces[body_index] = Vector2d<double>(fx, fy);
+    });
+}
+
+BoundingBox BarnesHutSimulation::calculate_forces_fused(Universe& universe, Quadtree& quadtree, double dt) {
+    if(multipole_order >= 2) {
+        quadtree.calculate_quadrupole_moments();
+    }
+    const bool use_quadrupole = multipole_order >= 2;
+    // the traversals read the positions of the other bodies from the tree, the position of a body can be overwritten
+    // as soon as its own force is known
+    FusedEulerUpdate update(universe, universe.positions.data(), dt);
+
+    if(quadtree.is_linear()) {
+        if(uses_bucket_traversal()) {
+            grouped_quadtree_forces(quadtree.linear_quadtree, threshold_theta, use_quadrupole, force_engine == 3, [&](std::int32_t body_index, double fx, double fy) {
+                update(body_index, fx, fy);
+            });
+        }
+        else {
+            linear_quadtree_forces(quadtree.linear_quadtree, threshold_theta, use_quadrupole, [&](std::int32_t body_index, double fx, double fy) {
+                update(body_index, fx, fy);
+            });
+        }
+    }
+    else if(force_engine != 0) {
+#pragma omp parallel for schedule(dynamic, 64)
+        for(int i = 0; i < universe.num_bodies; i++) {
+            Vector2d<double> f = stack_traversal_force(universe, quadtree, i, threshold_theta, use_quadrupole);
+            update(i, f[0], f[1]);
+        }
+    }
+    else {
+#pragma omp parallel for
+        for(int i = 0; i < universe.num_bodies; i++) {
+            Vector2d<double> f = relevant_nodes_force(universe, quadtree, i, threshold_theta, use_quadrupole);
+            update(i, f[0], f[1]);
+        }
+    }
+
+    universe.forces_current = false;
+    Integrator::force_evaluations++;
+    return update.get_bounding_box();
+}
+
+void BarnesHutSimulation::simulate_epochs(Plotter& plotter, UniverseSoA& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    for(int i = 0; i < num_epochs; i++){
+        simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
+    }
+}
+
+void BarnesHutSimulation::simulate_epoch(Plotter& plotter, UniverseSoA& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    Quadtree qt = Quadtree(universe, universe.get_bounding_box(), uses_bucket_traversal() ? bucket_size : 1);
+
+    calculate_forces(universe, qt);
+
+    NaiveParallelSimulation::calculate_velocities(universe);
+    NaiveParallelSimulation::calculate_positions(universe);
+
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.add_bodies_to_image(universe);
+        plotter.write_and_clear();
+    }
+}
+
+void BarnesHutSimulation::calculate_forces(UniverseSoA& universe, Quadtree& quadtree) {
+    double* force_x = universe.forces.x.data();
+    double* force_y = universe.forces.y.data();
+    if(multipole_order >= 2) {
+        quadtree.calculate_quadrupole_moments();
+    }
+    auto store_force = [=](std::int32_t body_index, double fx, double fy) {
+        force_x[body_index] = fx;
+        force_y[body_index] = fy;
+    };
+    if(uses_bucket_traversal()) {
+        grouped_quadtree_forces(quadtree.linear_quadtree, threshold_theta, multipole_order >= 2, force_engine == 3, store_force);
+    }
+    else {
+        linear_quadtree_forces(quadtree.linear_quadtree, threshold_theta, multipole_order >= 2, store_force);
+    }
+}
@@ -2,17 +2,75 @@
 
 
 #include "structures/universe.h"
+#include "structures/universe_soa.h"
 #include "quadtree/quadtree.h"
 #include "plotting/plotter.h"
 
+#include <memory>
+
 class BarnesHutSimulation{
 public:
+    // construct mode of the quadtree built every epoch, see Quadtree::Quadtree
+    static inline std::int8_t construct_mode = 2;
+    // force engine: 0 -> relevant node list (get_relevant_nodes), 1 -> explicit stack, no allocation per body,
+    // 2 -> bucket traversal on a linear quadtree with bucket_size bodies per leaf (pointer quadtrees fall back to 1),
+    // 3 -> bucket traversal in mixed precision: offsets to the accepted nodes in double, their contributions in float, sums in double
+    static inline std::int8_t force_engine = 0;
+    static inline std::uint32_t bucket_size = 16;
+    // opening criterion: a node is used as a whole if diagonal / distance < threshold_theta
+    static inline double threshold_theta = 0.2;
+    // 0 -> monopole, 2 -> monopole and quadrupole of the nodes
+    static inline std::int8_t multipole_order = 0;
+    // keep the pointer quadtree (construct modes 0-2, force engines 0 and 1) across epochs and refit it instead of rebuilding it
+    static inline bool incremental_tree = false;
+    // rebuild if more bodies than this fraction left their leaf or the tree got refit_max_extra_depth levels deeper
+    static inline double refit_max_moved_fraction = 0.25;
+    static inline std::int32_t refit_max_extra_depth = 8;
+    // the root box of a refitted tree is enlarged by this fraction on every side, bodies leaving it force a rebuild
+    static inline double refit_box_padding = 0.1;
+    static inline std::uint64_t tree_refits = 0;
+    static inline std::uint64_t tree_rebuilds = 0;
+    // the bodies are sorted along the Morton curve at the start of every reorder_interval-th epoch, 0 -> never
+    static inline std::uint32_t reorder_interval = 0;
+    // fused epoch pipeline, only with the euler integrator: the kick and drift of a body directly follow its force
+    // in the same parallel loop, which also reduces the bounding box for the tree of the next epoch
+    static inline bool fused_epoch = false;
+
     static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
     static void simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // epoch with a quadtree that is kept between the calls, see incremental_tree
+    static void simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // fused euler epoch, bounding_box has to be the box of the current positions and receives the box of the new ones.
+    // quadtree is only reused between the calls with incremental_tree
+    static void simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, BoundingBox& bounding_box, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // refits the quadtree to the current positions or rebuilds it if that is not possible
+    static void update_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree);
+    // same, a rebuild uses the given bounding box of the current positions
+    static void update_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree, const BoundingBox& bounding_box);
+    // tree for a fused epoch: refitted with incremental_tree, otherwise built on bounding_box
+    static void update_fused_quadtree(Universe& universe, std::unique_ptr<Quadtree>& quadtree, const BoundingBox& bounding_box);
+    // Morton reordering if the current epoch is due, see reorder_interval. returns true if the bodies were permuted
+    static bool reorder_bodies(Universe& universe);
     static void calculate_forces(Universe& universe, Quadtree& quadtree);
+    static void calculate_forces_stack(Universe& universe, Quadtree& quadtree, double threshold_theta);
+    // forces on the listed bodies only (explicit stack on the pointer quadtree), the other forces are left unchanged
+    static void calculate_forces(Universe& universe, Quadtree& quadtree, const std::vector<std::int32_t>& bodies);
+    static void calculate_forces_linear(Universe& universe, Quadtree& quadtree, double threshold_theta);
+    static void calculate_forces_grouped(Universe& universe, Quadtree& quadtree, double threshold_theta);
+    // forces of all bodies, each directly followed by the euler kick and drift of the body (see FusedEulerUpdate).
+    // universe.forces is not written, returns the bounding box of the new positions
+    static BoundingBox calculate_forces_fused(Universe& universe, Quadtree& quadtree, double dt);
+
+    // structure-of-arrays variants, these always use the linear quadtree
+    static void simulate_epochs(Plotter& plotter, UniverseSoA& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void simulate_epoch(Plotter& plotter, UniverseSoA& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void calculate_forces(UniverseSoA& universe, Quadtree& quadtree);
     static void get_relevant_nodes(Universe& universe, Quadtree& quadtree, std::vector<QuadtreeNode*>& relevant_nodes, Vector2d<double>& body_position, std::int32_t body_index, double threshold_theta);
 
 private:
+    // force engines 2 and 3 need the linear quadtree with bucket leaves
+    static bool uses_bucket_traversal() { return force_engine == 2 || force_engine == 3; }
+
     // Deklaration der rekursiven Methode
     static void get_relevant_nodes_recursive(QuadtreeNode* node, Universe& universe, Vector2d<double>& body_position, std::int32_t body_index, double threshold_theta, std::vector<QuadtreeNode*>& relevant_nodes);
 };
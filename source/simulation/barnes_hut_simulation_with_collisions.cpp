@@ -1,26 +1,312 @@
 #include "simulation/barnes_hut_simulation_with_collisions.h"
 //#include "simulation/barnes_hut_simulation.h"
-#include "simulation/naive_parallel_simulation.h"
+#include "simulation/integrator.h"
 //#include <omp.h>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <omp.h>
+
+namespace {
+    // body indices by decreasing weight, bodies absorb the lighter bodies after them.
+    // equal weights are ordered by index, so every engine resolves the collisions in the same order
+    std::vector<int> weight_order(Universe& universe) {
+        std::vector<std::pair<double, int>> weighted_indices(universe.num_bodies);
+        for (int i = 0; i < universe.num_bodies; i++) {
+            weighted_indices[i] = {universe.weights[i], i};
+        }
+        std::sort(weighted_indices.begin(), weighted_indices.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        std::vector<int> sorted_indices(universe.num_bodies);
+        for (int i = 0; i < universe.num_bodies; i++) {
+            sorted_indices[i] = weighted_indices[i].second;
+        }
+        return sorted_indices;
+    }
+
+    // position of every body in the weight order
+    std::vector<std::int32_t> weight_ranks(const std::vector<int>& sorted_indices) {
+        std::vector<std::int32_t> rank(sorted_indices.size());
+        for (std::size_t r = 0; r < sorted_indices.size(); r++) {
+            rank[sorted_indices[r]] = static_cast<std::int32_t>(r);
+        }
+        return rank;
+    }
+
+    // two bodies closer than the collision distance, by their positions in the weight order
+    struct CollisionPair{
+        std::int32_t first_rank;
+        std::int32_t second_rank;
+        std::int32_t cluster = 0;
+    };
+
+    // lock-free union-find, the root of every set is its smallest element.
+    // parents only ever point to smaller elements, so concurrent finds and unions cannot create cycles
+    class ConcurrentUnionFind{
+    public:
+        explicit ConcurrentUnionFind(std::int32_t size): parents(size) {
+            for (std::int32_t i = 0; i < size; i++) {
+                parents[i].store(i, std::memory_order_relaxed);
+            }
+        }
+
+        std::int32_t find(std::int32_t x) {
+            while (true) {
+                std::int32_t parent = parents[x].load(std::memory_order_relaxed);
+                if (parent == x) return x;
+                std::int32_t grandparent = parents[parent].load(std::memory_order_relaxed);
+                // path halving, if the exchange fails another thread already moved x closer to the root
+                parents[x].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+                x = grandparent;
+            }
+        }
+
+        void unite(std::int32_t a, std::int32_t b) {
+            while (true) {
+                a = find(a);
+                b = find(b);
+                if (a == b) return;
+                if (a > b) std::swap(a, b);
+                // fails if b stopped being a root in the meantime, then both roots are searched again
+                std::int32_t expected = b;
+                if (parents[b].compare_exchange_strong(expected, a)) return;
+            }
+        }
+
+    private:
+        std::vector<std::atomic<std::int32_t>> parents;
+    };
+
+    // the absorption of find_collisions restricted to the candidate pairs: in weight order, every body that is
+    // not absorbed yet absorbs all later bodies of its pairs that are not absorbed yet.
+    // bodies only influence each other through pairs, so the connected clusters of the pairs are resolved in parallel
+    void absorb_pairs(Universe& universe, const std::vector<int>& sorted_indices, std::vector<CollisionPair>& pairs, std::vector<std::uint8_t>& is_absorbed) {
+        const std::int64_t num_pairs = static_cast<std::int64_t>(pairs.size());
+        ConcurrentUnionFind clusters(static_cast<std::int32_t>(sorted_indices.size()));
+        #pragma omp parallel for
+        for (std::int64_t p = 0; p < num_pairs; p++) {
+            clusters.unite(pairs[p].first_rank, pairs[p].second_rank);
+        }
+        #pragma omp parallel for
+        for (std::int64_t p = 0; p < num_pairs; p++) {
+            pairs[p].cluster = clusters.find(pairs[p].first_rank);
+        }
+
+        // inside a cluster in the order of find_collisions
+        std::sort(pairs.begin(), pairs.end(), [](const CollisionPair& a, const CollisionPair& b) {
+            if (a.cluster != b.cluster) return a.cluster < b.cluster;
+            return a.first_rank != b.first_rank ? a.first_rank < b.first_rank : a.second_rank < b.second_rank;
+        });
+        std::vector<std::int64_t> cluster_begin;
+        for (std::int64_t p = 0; p < num_pairs; p++) {
+            if (p == 0 || pairs[p].cluster != pairs[p - 1].cluster) {
+                cluster_begin.push_back(p);
+            }
+        }
+        const std::int64_t num_clusters = static_cast<std::int64_t>(cluster_begin.size());
+        cluster_begin.push_back(num_pairs);
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (std::int64_t c = 0; c < num_clusters; c++) {
+            for (std::int64_t p = cluster_begin[c]; p < cluster_begin[c + 1]; p++) {
+                int i = sorted_indices[pairs[p].first_rank];
+                int j = sorted_indices[pairs[p].second_rank];
+                if (is_absorbed[i] || is_absorbed[j]) continue;
+
+                is_absorbed[j] = true;
+                double m2 = universe.weights[i] + universe.weights[j];
+                universe.velocities[i] = (universe.velocities[i] * universe.weights[i]  + universe.velocities[j] * universe.weights[j]) / m2;
+                universe.weights[i] = m2;
+            }
+        }
+    }
+
+    // survivors move to the front of the existing buffers in their original order: every thread compacts its chunk,
+    // then the chunks are shifted to their offsets from the prefix sum over the chunk counts, one thread per array
+    void compact_in_place(Universe& universe, const std::vector<std::uint8_t>& is_absorbed) {
+        const std::int64_t num_bodies = universe.num_bodies;
+        const std::int32_t num_chunks = omp_get_max_threads();
+        std::vector<std::int64_t> chunk_begin(num_chunks + 1);
+        for (std::int32_t c = 0; c <= num_chunks; c++) {
+            chunk_begin[c] = num_bodies * c / num_chunks;
+        }
+        const bool has_body_ids = universe.body_ids.size() == universe.num_bodies;
+        std::vector<std::int64_t> chunk_count(num_chunks);
+        #pragma omp parallel for schedule(static, 1)
+        for (std::int32_t c = 0; c < num_chunks; c++) {
+            std::int64_t kept = chunk_begin[c];
+            for (std::int64_t i = chunk_begin[c]; i < chunk_begin[c + 1]; i++) {
+                if (is_absorbed[i]) continue;
+                if (kept != i) {
+                    universe.weights[kept] = universe.weights[i];
+                    universe.forces[kept] = universe.forces[i];
+                    universe.velocities[kept] = universe.velocities[i];
+                    universe.positions[kept] = universe.positions[i];
+                    if (has_body_ids) {
+                        universe.body_ids[kept] = universe.body_ids[i];
+                    }
+                }
+                kept++;
+            }
+            chunk_count[c] = kept - chunk_begin[c];
+        }
+
+        std::vector<std::int64_t> chunk_offset(num_chunks + 1, 0);
+        for (std::int32_t c = 0; c < num_chunks; c++) {
+            chunk_offset[c + 1] = chunk_offset[c] + chunk_count[c];
+        }
+        const std::int64_t offset = chunk_offset[num_chunks];
+
+        // the target of a chunk can overlap the sources of the chunks before it, so the chunks of one array
+        // are shifted front to back. the arrays are independent and shifted in parallel
+        auto shift = [&](auto& values) {
+            for (std::int32_t c = 1; c < num_chunks; c++) {
+                // target before the source, std::copy allows the overlap, an unmoved chunk is skipped
+                if (chunk_offset[c] == chunk_begin[c]) continue;
+                std::copy(values.begin() + chunk_begin[c], values.begin() + chunk_begin[c] + chunk_count[c], values.begin() + chunk_offset[c]);
+            }
+        };
+        #pragma omp parallel sections
+        {
+            #pragma omp section
+            shift(universe.weights);
+            #pragma omp section
+            shift(universe.forces);
+            #pragma omp section
+            shift(universe.velocities);
+            #pragma omp section
+            shift(universe.positions);
+            #pragma omp section
+            if (has_body_ids) {
+                shift(universe.body_ids);
+            }
+        }
+
+        universe.num_bodies = static_cast<std::uint32_t>(offset);
+        universe.weights.resize(offset);
+        universe.forces.resize(offset);
+        universe.velocities.resize(offset);
+        universe.positions.resize(offset);
+        if (has_body_ids) {
+            universe.body_ids.resize(offset);
+            universe.update_body_slots();
+        }
+    }
+
+    // survivors in weight order: slots from a prefix sum over the weight order, then a parallel gather
+    void compact_in_weight_order(Universe& universe, const std::vector<int>& sorted_indices, const std::vector<std::uint8_t>& is_absorbed) {
+        const std::int64_t num_bodies = universe.num_bodies;
+        std::vector<std::int64_t> slots(num_bodies);
+        std::int64_t num_remaining = 0;
+        for (std::int64_t r = 0; r < num_bodies; r++) {
+            slots[r] = num_remaining;
+            num_remaining += is_absorbed[sorted_indices[r]] ? 0 : 1;
+        }
+
+        std::vector<double> remaining_weights(num_remaining);
+        std::vector<Vector2d<double>> remaining_positions(num_remaining);
+        std::vector<Vector2d<double>> remaining_velocities(num_remaining);
+        std::vector<Vector2d<double>> remaining_forces(num_remaining);
+        const bool has_body_ids = universe.body_ids.size() == universe.num_bodies;
+        std::vector<std::uint64_t> remaining_body_ids(has_body_ids ? num_remaining : 0);
+        #pragma omp parallel for
+        for (std::int64_t r = 0; r < num_bodies; r++) {
+            size_t index = sorted_indices[r];
+            if (is_absorbed[index]) continue;
+            remaining_weights[slots[r]] = universe.weights[index];
+            remaining_positions[slots[r]] = universe.positions[index];
+            remaining_velocities[slots[r]] = universe.velocities[index];
+            remaining_forces[slots[r]] = universe.forces[index];
+            if (has_body_ids) {
+                remaining_body_ids[slots[r]] = universe.body_ids[index];
+            }
+        }
+
+        universe.num_bodies = static_cast<std::uint32_t>(num_remaining);
+        universe.velocities = std::move(remaining_velocities);
+        universe.weights = std::move(remaining_weights);
+        universe.positions = std::move(remaining_positions);
+        universe.forces = std::move(remaining_forces);
+        if (has_body_ids) {
+            universe.body_ids = std::move(remaining_body_ids);
+            universe.update_body_slots();
+        }
+    }
+
+    // keeps the bodies that were not absorbed, see BarnesHutSimulationWithCollisions::preserve_body_order
+    void remove_absorbed(Universe& universe, const std::vector<int>& sorted_indices, const std::vector<std::uint8_t>& is_absorbed) {
+        // merged bodies have new weights and momenta
+        universe.forces_current = false;
+        if (BarnesHutSimulationWithCollisions::preserve_body_order) {
+            compact_in_place(universe, is_absorbed);
+        }
+        else {
+            compact_in_weight_order(universe, sorted_indices, is_absorbed);
+        }
+    }
+}
+
 void BarnesHutSimulationWithCollisions::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    if(fused_epoch && Integrator::integrator == IntegratorType::euler) {
+        BoundingBox bounding_box = universe.get_bounding_box();
+        for(int i = 0; i < num_epochs; i++){
+            simulate_epoch(plotter, universe, bounding_box, create_intermediate_plots, plot_intermediate_epochs);
+        }
+        return;
+    }
     for(int i = 0; i < num_epochs; i++){
         simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
     }
 }
 
 void BarnesHutSimulationWithCollisions::simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
-    Quadtree qt = Quadtree(universe, universe.get_bounding_box(), 2);   //construct mode ????
+    if(fused_epoch && Integrator::integrator == IntegratorType::euler) {
+        BoundingBox bounding_box = universe.get_bounding_box();
+        simulate_epoch(plotter, universe, bounding_box, create_intermediate_plots, plot_intermediate_epochs);
+        return;
+    }
+    reorder_bodies(universe);
+    std::unique_ptr<Quadtree> quadtree;
+    Integrator::step(universe, [&](Universe& u){
+        if(collision_engine == 2) {
+            // padded root box, the tree is refitted after the position update and reused for the collisions
+            update_quadtree(u, quadtree);
+        }
+        else {
+            quadtree = std::make_unique<Quadtree>(u, u.get_bounding_box(), construct_mode);
+            quadtree->calculate_moments();
+        }
+        calculate_forces(u, *quadtree);
+    });
 
-    qt.calculate_center_of_mass();
-    qt.calculate_cumulative_masses();
+    resolve_collisions(universe, quadtree);
 
-    calculate_forces(universe, qt);
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.write_and_clear();
+    }
+}
 
-    NaiveParallelSimulation::calculate_velocities(universe);
-    NaiveParallelSimulation::calculate_positions(universe);
+void BarnesHutSimulationWithCollisions::simulate_epoch(Plotter& plotter, Universe& universe, BoundingBox& bounding_box, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    reorder_bodies(universe);
+    std::unique_ptr<Quadtree> quadtree;
+    if(collision_engine == 2) {
+        update_quadtree(universe, quadtree, bounding_box);
+    }
+    else {
+        quadtree = std::make_unique<Quadtree>(universe, bounding_box, construct_mode);
+        quadtree->calculate_moments();
+    }
+    bounding_box = calculate_forces_fused(universe, *quadtree, Integrator::time_step);
 
-    find_collisions(universe);
+    const std::uint32_t num_bodies = universe.num_bodies;
+    resolve_collisions(universe, quadtree);
+    // merging moves bodies, the reduced box only stays exact if nothing collided
+    if(universe.num_bodies != num_bodies) {
+        bounding_box = universe.get_bounding_box();
+    }
 
     universe.current_simulation_epoch++;
     if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
@@ -28,17 +314,27 @@ void BarnesHutSimulationWithCollisions::simulate_epoch(Plotter& plotter, Univers
     }
 }
 
-void BarnesHutSimulationWithCollisions::find_collisions(Universe& universe){
-    std::vector<int> sorted_indices;
-    for (int i = 0; i < universe.num_bodies; i++) {
-        sorted_indices.push_back(i);
+void BarnesHutSimulationWithCollisions::resolve_collisions(Universe& universe, std::unique_ptr<Quadtree>& quadtree){
+    if(collision_engine == 1) {
+        find_collisions_grid(universe);
     }
-    std::sort(sorted_indices.begin(), sorted_indices.end(), [&](int a, int b) {
-        return universe.weights[a] > universe.weights[b];
-    });
+    else if(collision_engine == 2) {
+        update_quadtree(universe, quadtree);
+        find_collisions_quadtree(universe, *quadtree);
+    }
+    else if(collision_engine == 3) {
+        find_collisions_parallel(universe);
+    }
+    else {
+        find_collisions(universe);
+    }
+}
+
+void BarnesHutSimulationWithCollisions::find_collisions(Universe& universe){
+    std::vector<int> sorted_indices = weight_order(universe);
 
     // Speichert, ob ein Körper bereits "aufgenommen" wurde
-    std::vector is_absorbed(universe.num_bodies, false);
+    std::vector<std::uint8_t> is_absorbed(universe.num_bodies, false);
 
     for(int i = 0; i < sorted_indices.size(); i++) {
         if(is_absorbed[sorted_indices[i]])continue; //überspringe absorbierten Körper
@@ -48,7 +344,7 @@ void BarnesHutSimulationWithCollisions::find_collisions(Universe& universe){
             if(i == j || is_absorbed[sorted_indices[j]]) continue; //überspringe absorbierten Körper oder gleichen (i kann nicht mit i kollidieren)
 
             Vector2d<double> connect = universe.positions[sorted_indices[j]] - universe.positions[sorted_indices[i]] ;
-            if(connect.norm() < 100000000000) {
+            if(connect.norm() < collision_distance) {
                 is_absorbed[sorted_indices[j]] = true;
                 double m2 = universe.weights[sorted_indices[i]] + universe.weights[sorted_indices[j]];
 
@@ -62,95 +358,229 @@ void BarnesHutSimulationWithCollisions::find_collisions(Universe& universe){
     }
 
     //update Universe
-    std::vector<double> remaining_weights;
-    std::vector<Vector2d<double>> remaining_positions;
-    std::vector<Vector2d<double>> remaining_velocities;
-    std::vector<Vector2d<double>> remaining_forces;
+    remove_absorbed(universe, sorted_indices, is_absorbed);
+}
 
-    for (int i = 0; i < universe.num_bodies; i++) {
-        size_t index = sorted_indices[i];
-        if(!is_absorbed[index]) {
-            remaining_positions.push_back(universe.positions[index]);
-            remaining_velocities.push_back(universe.velocities[index]);
-            remaining_weights.push_back(universe.weights[index]);
-            remaining_forces.push_back(universe.forces[index]);
+void BarnesHutSimulationWithCollisions::find_collisions_grid(Universe& universe){
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    std::vector<int> sorted_indices = weight_order(universe);
+    std::vector<std::int32_t> rank = weight_ranks(sorted_indices);
+
+    // bodies sorted by grid cell, key = (cell x << 32) | cell y
+    double x_min = std::numeric_limits<double>::max();
+    double y_min = std::numeric_limits<double>::max();
+    for (const auto& position : universe.positions) {
+        x_min = std::min(x_min, position[0]);
+        y_min = std::min(y_min, position[1]);
+    }
+    // the cells are clamped, so cell + 1 still fits into 32 bits. bodies within collision_distance stay in
+    // neighbouring cells, only the last row and column grow
+    const double max_cell = 4294967294.0;
+    std::vector<std::pair<std::uint64_t, std::int32_t>> cells(num_bodies);
+    #pragma omp parallel for
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        auto cell_x = static_cast<std::uint64_t>(std::min((universe.positions[i][0] - x_min) / collision_distance, max_cell));
+        auto cell_y = static_cast<std::uint64_t>(std::min((universe.positions[i][1] - y_min) / collision_distance, max_cell));
+        cells[i] = {(cell_x << 32) | cell_y, i};
+    }
+    std::sort(cells.begin(), cells.end());
+
+    std::vector<std::int32_t> cell_begin;
+    for (std::int32_t k = 0; k < num_bodies; k++) {
+        if (k == 0 || cells[k].first != cells[k - 1].first) {
+            cell_begin.push_back(k);
         }
     }
+    const std::int32_t num_cells = static_cast<std::int32_t>(cell_begin.size());
+    cell_begin.push_back(num_bodies);
+
+    // cell index of every body and the occupied cells in the 3x3 block around a cell
+    std::vector<std::int32_t> body_cell(num_bodies);
+    #pragma omp parallel for
+    for (std::int32_t c = 0; c < num_cells; c++) {
+        for (std::int32_t k = cell_begin[c]; k < cell_begin[c + 1]; k++) {
+            body_cell[cells[k].second] = c;
+        }
+    }
+    auto for_each_neighbour = [&](std::int32_t c, auto&& visit) {
+        std::uint64_t key = cells[cell_begin[c]].first;
+        std::uint64_t cell_x = key >> 32;
+        std::uint64_t cell_y = key & 0xffffffffu;
+        // (x', y - 1), (x', y) and (x', y + 1) are contiguous in key order
+        for (std::uint64_t x = cell_x == 0 ? 0 : cell_x - 1; x <= cell_x + 1; x++) {
+            std::uint64_t first_key = (x << 32) | (cell_y == 0 ? 0 : cell_y - 1);
+            std::uint64_t last_key = (x << 32) | (cell_y + 1);
+            auto first = std::lower_bound(cells.begin(), cells.end(), std::make_pair(first_key, std::int32_t{0}));
+            for (auto other = first; other != cells.end() && other->first <= last_key; ++other) {
+                visit(other->second);
+            }
+        }
+    };
+    auto collide = [&](std::int32_t a, std::int32_t b) {
+        Vector2d<double> connect = universe.positions[b] - universe.positions[a];
+        return connect.norm() < collision_distance;
+    };
+
+    // the colliding pairs are streamed into the clusters instead of being stored, a dense cell would need O(k^2) pairs.
+    // every cell is checked against itself and the four neighbours after it, so every pair of cells is checked once
+    ConcurrentUnionFind clusters(num_bodies);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::int32_t c = 0; c < num_cells; c++) {
+        auto unite_pair = [&](std::int32_t a, std::int32_t b) {
+            if (collide(a, b)) {
+                clusters.unite(rank[a], rank[b]);
+            }
+        };
 
-    universe.num_bodies = remaining_positions.size();
-    universe.velocities = remaining_velocities;
-    universe.weights = remaining_weights;
-    universe.positions = remaining_positions;
-    universe.forces = remaining_forces;
+        for (std::int32_t k = cell_begin[c]; k < cell_begin[c + 1]; k++) {
+            for (std::int32_t l = k + 1; l < cell_begin[c + 1]; l++) {
+                unite_pair(cells[k].second, cells[l].second);
+            }
+        }
 
-    universe.velocities.resize(universe.num_bodies);
-    universe.weights.resize(universe.num_bodies);
-    universe.positions.resize(universe.num_bodies);
-    universe.velocities.resize(universe.num_bodies);
+        std::uint64_t key = cells[cell_begin[c]].first;
+        std::uint64_t cell_x = key >> 32;
+        std::uint64_t cell_y = key & 0xffffffffu;
+        auto check_cell = [&](std::int32_t other) {
+            for (std::int32_t k = cell_begin[c]; k < cell_begin[c + 1]; k++) {
+                unite_pair(cells[k].second, cells[other].second);
+            }
+        };
+        // (x, y + 1) directly follows in key order if it is occupied
+        if (c + 1 < num_cells && cells[cell_begin[c + 1]].first == key + 1) {
+            for (std::int32_t other = cell_begin[c + 1]; other < cell_begin[c + 2]; other++) {
+                check_cell(other);
+            }
+        }
+        // (x + 1, y - 1), (x + 1, y) and (x + 1, y + 1) are contiguous in key order
+        std::uint64_t first_key = ((cell_x + 1) << 32) | (cell_y == 0 ? 0 : cell_y - 1);
+        std::uint64_t last_key = ((cell_x + 1) << 32) | (cell_y + 1);
+        auto first = std::lower_bound(cells.begin(), cells.end(), std::make_pair(first_key, std::int32_t{0}));
+        for (auto other = first; other != cells.end() && other->first <= last_key; ++other) {
+            check_cell(static_cast<std::int32_t>(other - cells.begin()));
+        }
+    }
 
+    // members of every cluster with a collision in weight order, the root is the smallest rank of its cluster
+    std::vector<std::int32_t> roots(num_bodies);
+    #pragma omp parallel for
+    for (std::int32_t r = 0; r < num_bodies; r++) {
+        roots[r] = clusters.find(r);
+    }
+    std::vector<std::pair<std::int32_t, std::int32_t>> members;
+    for (std::int32_t r = 0; r < num_bodies; r++) {
+        if (roots[r] == r) continue;
+        if (roots[roots[r]] >= 0) {
+            members.push_back({roots[r], roots[r]});
+            roots[roots[r]] = -1;
+        }
+        members.push_back({roots[r], r});
+    }
+    std::sort(members.begin(), members.end());
+    const std::int32_t num_members = static_cast<std::int32_t>(members.size());
+    std::vector<std::int32_t> cluster_begin;
+    for (std::int32_t k = 0; k < num_members; k++) {
+        if (k == 0 || members[k].first != members[k - 1].first) {
+            cluster_begin.push_back(k);
+        }
+    }
+    const std::int32_t num_clusters = static_cast<std::int32_t>(cluster_begin.size());
+    cluster_begin.push_back(num_members);
+
+    // the absorption of find_collisions inside every cluster, the neighbours are searched again instead of
+    // reading stored pairs. colliding bodies are in the same cluster, so the clusters are resolved in parallel
+    std::vector<std::uint8_t> is_absorbed(num_bodies, false);
+    #pragma omp parallel
+    {
+        std::vector<std::int32_t> absorbed_ranks;
+        #pragma omp for schedule(dynamic, 64)
+        for (std::int32_t c = 0; c < num_clusters; c++) {
+            for (std::int32_t k = cluster_begin[c]; k < cluster_begin[c + 1]; k++) {
+                int i = sorted_indices[members[k].second];
+                if (is_absorbed[i]) continue;
+                absorbed_ranks.clear();
+                for_each_neighbour(body_cell[i], [&](std::int32_t j) {
+                    if (rank[j] > rank[i] && collide(i, j) && !is_absorbed[j]) {
+                        absorbed_ranks.push_back(rank[j]);
+                    }
+                });
+                // merged in weight order like find_collisions, the momenta are then summed in the same order
+                std::sort(absorbed_ranks.begin(), absorbed_ranks.end());
+                for (std::int32_t absorbed_rank : absorbed_ranks) {
+                    int j = sorted_indices[absorbed_rank];
+                    is_absorbed[j] = true;
+                    double m2 = universe.weights[i] + universe.weights[j];
+                    universe.velocities[i] = (universe.velocities[i] * universe.weights[i]  + universe.velocities[j] * universe.weights[j]) / m2;
+                    universe.weights[i] = m2;
+                }
+            }
+        }
+    }
+    remove_absorbed(universe, sorted_indices, is_absorbed);
 }
 
-void BarnesHutSimulationWithCollisions::find_collisions_parallel(Universe& universe) {
-    std::vector<int> sorted_indices;
-    for (int i = 0; i < universe.num_bodies; i++) {
-        sorted_indices.push_back(i);
+void BarnesHutSimulationWithCollisions::find_collisions_quadtree(Universe& universe, Quadtree& quadtree){
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    std::vector<int> sorted_indices = weight_order(universe);
+    std::vector<std::int32_t> rank = weight_ranks(sorted_indices);
+
+    // every pair is kept by the query of its heavier body. the queries run in tree order,
+    // consecutive queries then walk down the same paths
+    std::vector<std::int32_t> query_order = quadtree.bodies_in_tree_order();
+    const std::int32_t num_queries = static_cast<std::int32_t>(query_order.size());
+    std::vector<std::vector<CollisionPair>> thread_pairs(omp_get_max_threads());
+    #pragma omp parallel
+    {
+        auto& pairs = thread_pairs[omp_get_thread_num()];
+        std::vector<std::int32_t> neighbours;
+        #pragma omp for schedule(dynamic, 256)
+        for (std::int32_t q = 0; q < num_queries; q++) {
+            std::int32_t i = query_order[q];
+            neighbours.clear();
+            quadtree.query_radius(universe, universe.positions[i], collision_distance, neighbours);
+            for (std::int32_t j : neighbours) {
+                if (rank[j] > rank[i]) {
+                    pairs.push_back({rank[i], rank[j]});
+                }
+            }
+        }
     }
-    std::sort(sorted_indices.begin(), sorted_indices.end(), [&](int a, int b) {
-        return universe.weights[a] > universe.weights[b];
-    });
-
-    // Speichert, ob ein Körper bereits "aufgenommen" wurde
-    std::vector is_absorbed(universe.num_bodies, false);
-
 
-    for(int i = 0; i < sorted_indices.size(); i++) {
-        if(is_absorbed[sorted_indices[i]])continue; //überspringe absorbierten Körper
-        //finde alle Körper, die mit i Kollidieren
-
-#pragma omp parallel for
-        for(int j = i+1; j < sorted_indices.size(); j++) {
-            if(i == j || is_absorbed[sorted_indices[j]]) continue; //überspringe absorbierten Körper oder gleichen (i kann nicht mit i kollidieren)
-
-            Vector2d<double> connect = universe.positions[sorted_indices[j]] - universe.positions[sorted_indices[i]] ;
-            if(connect.norm() < 100000000000) {
-                is_absorbed[sorted_indices[j]] = true;
-                double m2 = universe.weights[sorted_indices[i]] + universe.weights[sorted_indices[j]];
+    std::vector<CollisionPair> pairs;
+    for (const auto& local_pairs : thread_pairs) {
+        pairs.insert(pairs.end(), local_pairs.begin(), local_pairs.end());
+    }
 
-                //Geschwindigkeit nach Impulserhaltung
-                universe.velocities[sorted_indices[i]] = ((universe.velocities[sorted_indices[i]] * universe.weights[sorted_indices[i]])  + (universe.velocities[sorted_indices[j]] * universe.weights[sorted_indices[j]])) / m2;
+    std::vector<std::uint8_t> is_absorbed(num_bodies, false);
+    absorb_pairs(universe, sorted_indices, pairs, is_absorbed);
+    remove_absorbed(universe, sorted_indices, is_absorbed);
+}
 
-                //neues Gewicht zuweisen
-                universe.weights[sorted_indices[i]] = m2;
+void BarnesHutSimulationWithCollisions::find_collisions_parallel(Universe& universe) {
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    std::vector<int> sorted_indices = weight_order(universe);
+
+    // all pairs in parallel, nothing is written until the pairs are complete
+    std::vector<std::vector<CollisionPair>> thread_pairs(omp_get_max_threads());
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        auto& pairs = thread_pairs[omp_get_thread_num()];
+        for (std::int32_t j = i + 1; j < num_bodies; j++) {
+            Vector2d<double> connect = universe.positions[sorted_indices[j]] - universe.positions[sorted_indices[i]];
+            if (connect.norm() < collision_distance) {
+                pairs.push_back({i, j});
             }
         }
     }
 
-    //update Universe
-    std::vector<double> remaining_weights;
-    std::vector<Vector2d<double>> remaining_positions;
-    std::vector<Vector2d<double>> remaining_velocities;
-    std::vector<Vector2d<double>> remaining_forces;
-
-    for (int i = 0; i < universe.num_bodies; i++) {
-        size_t index = sorted_indices[i];
-        if(!is_absorbed[index]) {
-            remaining_positions.push_back(universe.positions[index]);
-            remaining_velocities.push_back(universe.velocities[index]);
-            remaining_weights.push_back(universe.weights[index]);
-            remaining_forces.push_back(universe.forces[index]);
-        }
+    std::vector<CollisionPair> pairs;
+    for (const auto& local_pairs : thread_pairs) {
+        pairs.insert(pairs.end(), local_pairs.begin(), local_pairs.end());
     }
 
-    universe.num_bodies = remaining_positions.size();
-    universe.velocities = remaining_velocities;
-    universe.weights = remaining_weights;
-    universe.positions = remaining_positions;
-    universe.forces = remaining_forces;
-
-    universe.velocities.resize(universe.num_bodies);
-    universe.weights.resize(universe.num_bodies);
-    universe.positions.resize(universe.num_bodies);
-    universe.velocities.resize(universe.num_bodies);
+    std::vector<std::uint8_t> is_absorbed(num_bodies, false);
+    absorb_pairs(universe, sorted_indices, pairs, is_absorbed);
+    remove_absorbed(universe, sorted_indices, is_absorbed);
 }
 
 
@@ -6,7 +6,31 @@ class BarnesHutSimulationWithCollisions : BarnesHutSimulation {
 public:
     static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
     static void simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // fused euler epoch (see BarnesHutSimulation::fused_epoch), bounding_box has to be the box of the current positions
+    // and receives the box of the positions after the collisions
+    static void simulate_epoch(Plotter& plotter, Universe& universe, BoundingBox& bounding_box, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
 
     static void find_collisions(Universe& universe);
+    // same result as find_collisions: all pairs are collected in parallel, the clusters of colliding bodies
+    // are merged in parallel afterwards
     static void find_collisions_parallel(Universe& universe);
+    // same result as find_collisions, candidates are only searched in the neighbouring cells of a uniform grid
+    // with cell size collision_distance
+    static void find_collisions_grid(Universe& universe);
+    // same result as find_collisions, candidates are found with radius queries on a quadtree that matches the current positions
+    static void find_collisions_quadtree(Universe& universe, Quadtree& quadtree);
+
+    // bodies closer than this are merged, the heavier body absorbs the lighter one
+    static inline double collision_distance = 100000000000;
+    // 0 -> all pairs (find_collisions), 1 -> uniform grid (find_collisions_grid),
+    // 2 -> the Barnes-Hut quadtree, refitted to the new positions (find_collisions_quadtree),
+    // 3 -> all pairs in parallel (find_collisions_parallel)
+    static inline std::int8_t collision_engine = 0;
+    // true -> the remaining bodies keep their order and are compacted in place,
+    // false -> the remaining bodies are sorted by decreasing weight
+    static inline bool preserve_body_order = false;
+
+private:
+    // merges the colliding bodies with the selected collision_engine, engine 2 refits quadtree to the new positions
+    static void resolve_collisions(Universe& universe, std::unique_ptr<Quadtree>& quadtree);
 };
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "simulation/block_timestep_simulation.h"
+#include "simulation/barnes_hut_simulation.h"
+#include "simulation/integrator.h"
+#include "physics/mechanics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <omp.h>
+
+void BlockTimestepSimulation::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    std::unique_ptr<Quadtree> quadtree;
+    for(int i = 0; i < num_epochs; i++){
+        simulate_epoch(plotter, universe, quadtree, create_intermediate_plots, plot_intermediate_epochs);
+    }
+}
+
+std::int32_t BlockTimestepSimulation::timestep_level(const Vector2d<double>& force, double mass, double time_step){
+    double acceleration = calculate_acceleration(force, mass).norm();
+    if(!(acceleration > 0)){
+        return 0;
+    }
+    double step = std::sqrt(2 * timestep_eta * timestep_length / acceleration);
+    if(!(step < time_step)){
+        return 0;
+    }
+    if(!(step > 0)){
+        return max_level;
+    }
+    auto level = static_cast<std::int32_t>(std::ceil(std::log2(time_step / step)));
+    return std::clamp(level, 0, max_level);
+}
+
+void BlockTimestepSimulation::simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    const std::int32_t num_bodies = static_cast<std::int32_t>(universe.num_bodies);
+    // time in ticks of the finest step
+    const std::int64_t ticks = std::int64_t{1} << max_level;
+    const double tick = Integrator::time_step / static_cast<double>(ticks);
+
+    std::vector<std::int32_t> active(num_bodies);
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        active[i] = i;
+    }
+    if(!universe.forces_current){
+        BarnesHutSimulation::update_quadtree(universe, quadtree);
+        BarnesHutSimulation::calculate_forces(universe, *quadtree, active);
+        body_force_evaluations += num_bodies;
+    }
+
+    // step length and end of the current step of every body
+    std::vector<std::int64_t> step(num_bodies);
+    std::vector<std::int64_t> step_end(num_bodies);
+    std::int64_t finest_step = ticks;
+    #pragma omp parallel for reduction(min:finest_step)
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        std::int32_t level = timestep_level(universe.forces[i], universe.weights[i], Integrator::time_step);
+        step[i] = ticks >> level;
+        step_end[i] = step[i];
+        finest_step = std::min(finest_step, step[i]);
+    }
+
+    std::int64_t t = 0;
+    while(t < ticks){
+        // first half kick of the bodies that start a step
+        const std::int64_t num_active = static_cast<std::int64_t>(active.size());
+        #pragma omp parallel for
+        for(std::int64_t k = 0; k < num_active; k++){
+            std::int32_t i = active[k];
+            Vector2d<double> acceleration = calculate_acceleration(universe.forces[i], universe.weights[i]);
+            universe.velocities[i] = calculate_velocity(universe.velocities[i], acceleration, step[i] * tick / 2);
+        }
+
+        // all bodies drift to the next end of a step
+        std::int64_t next = ticks;
+        #pragma omp parallel for reduction(min:next)
+        for(std::int32_t i = 0; i < num_bodies; i++){
+            next = std::min(next, step_end[i]);
+        }
+        const double dt = static_cast<double>(next - t) * tick;
+        #pragma omp parallel for
+        for(std::int32_t i = 0; i < num_bodies; i++){
+            universe.positions[i] = universe.positions[i] + universe.velocities[i] * dt;
+        }
+        t = next;
+
+        active.clear();
+        for(std::int32_t i = 0; i < num_bodies; i++){
+            if(step_end[i] == t){
+                active.push_back(i);
+            }
+        }
+        BarnesHutSimulation::update_quadtree(universe, quadtree);
+        BarnesHutSimulation::calculate_forces(universe, *quadtree, active);
+        body_force_evaluations += active.size();
+
+        // second half kick, then the next step. a step has to start at a multiple of its length,
+        // so a body only moves to a coarser level at aligned times
+        const std::int64_t aligned_step = t == ticks ? ticks : (t & -t);
+        const std::int64_t num_finished = static_cast<std::int64_t>(active.size());
+        #pragma omp parallel for reduction(min:finest_step)
+        for(std::int64_t k = 0; k < num_finished; k++){
+            std::int32_t i = active[k];
+            Vector2d<double> acceleration = calculate_acceleration(universe.forces[i], universe.weights[i]);
+            universe.velocities[i] = calculate_velocity(universe.velocities[i], acceleration, step[i] * tick / 2);
+
+            std::int32_t level = timestep_level(universe.forces[i], universe.weights[i], Integrator::time_step);
+            step[i] = std::min(ticks >> level, aligned_step);
+            step_end[i] = t + step[i];
+            finest_step = std::min(finest_step, step[i]);
+        }
+    }
+    // every step ended with the epoch, all forces belong to the final positions
+    universe.forces_current = true;
+    finest_level = max_level - static_cast<std::int32_t>(std::log2(static_cast<double>(finest_step)));
+
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.add_bodies_to_image(universe);
+        plotter.write_and_clear();
+    }
+}
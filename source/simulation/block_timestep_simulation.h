@@ -0,0 +1,32 @@
+#pragma once
+
+#include "structures/universe.h"
+#include "quadtree/quadtree.h"
+#include "plotting/plotter.h"
+
+#include <memory>
+
+// Barnes-Hut with individual time steps: every body advances with Integrator::time_step / 2^level, where the level
+// follows from its acceleration. Bodies are kicked (leapfrog, kick-drift-kick) only at the ends of their own steps,
+// so every substep computes the forces of the bodies whose step ends there. all bodies drift together and are
+// synchronized at the end of every epoch. the quadtree is refitted between the substeps (BarnesHutSimulation::update_quadtree),
+// so the drift and the refit of a substep still cost O(N), only the forces are restricted to the active bodies
+class BlockTimestepSimulation{
+public:
+    static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void simulate_epoch(Plotter& plotter, Universe& universe, std::unique_ptr<Quadtree>& quadtree, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // smallest level with time_step / 2^level <= sqrt(2 * timestep_eta * timestep_length / |a|), clamped to [0, max_level].
+    // unlike |v| / |a| this does not force bodies at rest onto the finest level
+    static std::int32_t timestep_level(const Vector2d<double>& force, double mass, double time_step);
+
+    // finest step is Integrator::time_step / 2^max_level
+    static inline std::int32_t max_level = 8;
+    // within one of its steps the acceleration of a body moves it by at most timestep_eta * timestep_length (in m)
+    static inline double timestep_eta = 0.05;
+    static inline double timestep_length = 1e12;
+
+    // forces computed for single bodies, a global step with the finest level needs num_bodies * 2^finest_level per epoch
+    static inline std::uint64_t body_force_evaluations = 0;
+    // finest level used in the last epoch
+    static inline std::int32_t finest_level = 0;
+};
@@ -0,0 +1,381 @@
+#include "simulation/fast_multipole_simulation.h"
+#include "simulation/integrator.h"
+#include "physics/gravitation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+
+// the coefficient of the multi-index k = (kx, ky), |k| <= p, is stored at n(n+1)/2 + ky with n = kx + ky
+static inline std::int32_t coefficient_index(std::int32_t kx, std::int32_t ky){
+    std::int32_t n = kx + ky;
+    return n * (n + 1) / 2 + ky;
+}
+
+// expansions are Taylor series of the potential sum(m / |x - s|), the multipole of a cell around its center c is
+// M_k = sum m (-a)^k / k! (a = s - c), the local expansion around c is L_n = d^n phi / dx^n,
+// both are translated with derivatives D_k(R) of 1/|R|
+class FastMultipoleSolver{
+public:
+    FastMultipoleSolver(const LinearQuadtree& arg_tree, std::int32_t order, double theta)
+        : tree(arg_tree), p(order), num_coefficients((order + 1) * (order + 2) / 2), theta_squared(theta * theta){
+        inverse_factorial.resize(p + 1);
+        inverse_factorial[0] = 1.0;
+        for(std::int32_t k = 1; k <= p; k++){
+            inverse_factorial[k] = inverse_factorial[k - 1] / k;
+        }
+
+        const std::size_t num_nodes = tree.nodes.size();
+        multipoles.assign(num_nodes * num_coefficients, 0.0);
+        locals.assign(num_nodes * num_coefficients, 0.0);
+        radius.assign(num_nodes, 0.0);
+        sum_x.assign(tree.body_x.size(), 0.0);
+        sum_y.assign(tree.body_x.size(), 0.0);
+
+        // nodes are stored breadth first, every level is a contiguous range
+        level_begin.push_back(0);
+        for(std::size_t k = 1; k < num_nodes; k++){
+            if(tree.nodes[k].level != tree.nodes[k - 1].level){
+                level_begin.push_back(static_cast<std::int32_t>(k));
+            }
+        }
+        level_begin.push_back(static_cast<std::int32_t>(num_nodes));
+    }
+
+    // result is sum(m_j (s_j - x) / r^3) per Morton slot, the force is G * m * sum
+    void solve(){
+        upward_pass();
+
+        #pragma omp parallel
+        #pragma omp single
+        interact(0, 0);
+
+        downward_pass();
+    }
+
+    std::vector<double> sum_x;
+    std::vector<double> sum_y;
+
+private:
+    // bodies per target cell above which the traversal spawns tasks
+    static constexpr std::int32_t task_cutoff = 2048;
+
+    // x^k / k! for k = 0..max_power
+    void scaled_powers(double x, std::int32_t max_power, double* result) const {
+        double power = 1.0;
+        for(std::int32_t k = 0; k <= max_power; k++){
+            result[k] = power * inverse_factorial[k];
+            power *= x;
+        }
+    }
+
+    double* multipole(std::int32_t node_index){
+        return multipoles.data() + static_cast<std::size_t>(node_index) * num_coefficients;
+    }
+
+    double* local(std::int32_t node_index){
+        return locals.data() + static_cast<std::size_t>(node_index) * num_coefficients;
+    }
+
+    void particle_to_multipole(std::int32_t node_index){
+        const LinearQuadtreeNode& node = tree.nodes[node_index];
+        double* m = multipole(node_index);
+        double power_x[FastMultipoleSimulation::max_expansion_order + 1];
+        double power_y[FastMultipoleSimulation::max_expansion_order + 1];
+        double r = 0.0;
+
+        for(std::int32_t j = node.first_body; j < node.first_body + node.body_count; j++){
+            double ax = tree.body_x[j] - node.center_of_mass_x;
+            double ay = tree.body_y[j] - node.center_of_mass_y;
+            r = std::max(r, std::sqrt(ax * ax + ay * ay));
+            scaled_powers(-ax, p, power_x);
+            scaled_powers(-ay, p, power_y);
+            for(std::int32_t n = 0; n <= p; n++){
+                for(std::int32_t ky = 0; ky <= n; ky++){
+                    m[coefficient_index(n - ky, ky)] += tree.body_mass[j] * power_x[n - ky] * power_y[ky];
+                }
+            }
+        }
+        radius[node_index] = r;
+    }
+
+    void multipole_to_multipole(std::int32_t parent_index){
+        const LinearQuadtreeNode& parent = tree.nodes[parent_index];
+        double* m = multipole(parent_index);
+        double power_x[FastMultipoleSimulation::max_expansion_order + 1];
+        double power_y[FastMultipoleSimulation::max_expansion_order + 1];
+        double r = 0.0;
+
+        for(std::int32_t c = parent.first_child; c < parent.first_child + parent.child_count; c++){
+            const LinearQuadtreeNode& child = tree.nodes[c];
+            const double* child_m = multipole(c);
+            double dx = child.center_of_mass_x - parent.center_of_mass_x;
+            double dy = child.center_of_mass_y - parent.center_of_mass_y;
+            r = std::max(r, std::sqrt(dx * dx + dy * dy) + radius[c]);
+            scaled_powers(-dx, p, power_x);
+            scaled_powers(-dy, p, power_y);
+
+            // M_k += sum_{l <= k} M_child_l (-d)^(k-l) / (k-l)!
+            for(std::int32_t n = 0; n <= p; n++){
+                for(std::int32_t ky = 0; ky <= n; ky++){
+                    std::int32_t kx = n - ky;
+                    double value = 0.0;
+                    for(std::int32_t lx = 0; lx <= kx; lx++){
+                        for(std::int32_t ly = 0; ly <= ky; ly++){
+                            value += child_m[coefficient_index(lx, ly)] * power_x[kx - lx] * power_y[ky - ly];
+                        }
+                    }
+                    m[coefficient_index(kx, ky)] += value;
+                }
+            }
+        }
+        radius[parent_index] = r;
+    }
+
+    // derivatives D_k of 1/|R| up to order p,
+    // |k| r^2 D_k = -(2|k|-1) sum_i k_i R_i D_{k-e_i} - (|k|-1) sum_i k_i (k_i-1) D_{k-2e_i}
+    void derivatives(double rx, double ry, double* d) const {
+        double r_squared = rx * rx + ry * ry;
+        d[0] = 1.0 / std::sqrt(r_squared);
+        for(std::int32_t n = 1; n <= p; n++){
+            for(std::int32_t ky = 0; ky <= n; ky++){
+                std::int32_t kx = n - ky;
+                double value = 0.0;
+                if(kx >= 1) value -= (2 * n - 1) * kx * rx * d[coefficient_index(kx - 1, ky)];
+                if(ky >= 1) value -= (2 * n - 1) * ky * ry * d[coefficient_index(kx, ky - 1)];
+                if(kx >= 2) value -= (n - 1) * kx * (kx - 1) * d[coefficient_index(kx - 2, ky)];
+                if(ky >= 2) value -= (n - 1) * ky * (ky - 1) * d[coefficient_index(kx, ky - 2)];
+                d[coefficient_index(kx, ky)] = value / (n * r_squared);
+            }
+        }
+    }
+
+    void multipole_to_local(std::int32_t target_index, std::int32_t source_index){
+        const LinearQuadtreeNode& target = tree.nodes[target_index];
+        const LinearQuadtreeNode& source = tree.nodes[source_index];
+        double d[(FastMultipoleSimulation::max_expansion_order + 1) * (FastMultipoleSimulation::max_expansion_order + 2) / 2];
+        derivatives(target.center_of_mass_x - source.center_of_mass_x, target.center_of_mass_y - source.center_of_mass_y, d);
+
+        const double* m = multipole(source_index);
+        double* l = local(target_index);
+        // L_n += sum_{|n+k| <= p} D_{n+k} M_k
+        for(std::int32_t n = 0; n <= p; n++){
+            for(std::int32_t ny = 0; ny <= n; ny++){
+                std::int32_t nx = n - ny;
+                double value = 0.0;
+                for(std::int32_t k = 0; k <= p - n; k++){
+                    for(std::int32_t ky = 0; ky <= k; ky++){
+                        value += d[coefficient_index(nx + k - ky, ny + ky)] * m[coefficient_index(k - ky, ky)];
+                    }
+                }
+                l[coefficient_index(nx, ny)] += value;
+            }
+        }
+    }
+
+    void local_to_local(std::int32_t parent_index, std::int32_t child_index){
+        const LinearQuadtreeNode& parent = tree.nodes[parent_index];
+        const LinearQuadtreeNode& child = tree.nodes[child_index];
+        double power_x[FastMultipoleSimulation::max_expansion_order + 1];
+        double power_y[FastMultipoleSimulation::max_expansion_order + 1];
+        scaled_powers(child.center_of_mass_x - parent.center_of_mass_x, p, power_x);
+        scaled_powers(child.center_of_mass_y - parent.center_of_mass_y, p, power_y);
+
+        const double* l = local(parent_index);
+        double* child_l = local(child_index);
+        // L_child_n += sum_{|n+k| <= p} L_{n+k} d^k / k!
+        for(std::int32_t n = 0; n <= p; n++){
+            for(std::int32_t ny = 0; ny <= n; ny++){
+                std::int32_t nx = n - ny;
+                double value = 0.0;
+                for(std::int32_t k = 0; k <= p - n; k++){
+                    for(std::int32_t ky = 0; ky <= k; ky++){
+                        value += l[coefficient_index(nx + k - ky, ny + ky)] * power_x[k - ky] * power_y[ky];
+                    }
+                }
+                child_l[coefficient_index(nx, ny)] += value;
+            }
+        }
+    }
+
+    // gradient of the local expansion at the bodies of a leaf
+    void local_to_particle(std::int32_t node_index){
+        const LinearQuadtreeNode& node = tree.nodes[node_index];
+        const double* l = local(node_index);
+        double power_x[FastMultipoleSimulation::max_expansion_order + 1];
+        double power_y[FastMultipoleSimulation::max_expansion_order + 1];
+
+        for(std::int32_t i = node.first_body; i < node.first_body + node.body_count; i++){
+            scaled_powers(tree.body_x[i] - node.center_of_mass_x, p - 1, power_x);
+            scaled_powers(tree.body_y[i] - node.center_of_mass_y, p - 1, power_y);
+            double gx = 0.0;
+            double gy = 0.0;
+            for(std::int32_t n = 0; n < p; n++){
+                for(std::int32_t ny = 0; ny <= n; ny++){
+                    std::int32_t nx = n - ny;
+                    double power = power_x[nx] * power_y[ny];
+                    gx += l[coefficient_index(nx + 1, ny)] * power;
+                    gy += l[coefficient_index(nx, ny + 1)] * power;
+                }
+            }
+            sum_x[i] += gx;
+            sum_y[i] += gy;
+        }
+    }
+
+    // direct summation, only the bodies of the target are written. the softening (Gravitation::softening_length) is
+    // applied here, the expansions of well separated cells stay Newtonian
+    void particle_to_particle(std::int32_t target_index, std::int32_t source_index){
+        const LinearQuadtreeNode& target = tree.nodes[target_index];
+        const LinearQuadtreeNode& source = tree.nodes[source_index];
+        const double* source_x = tree.body_x.data();
+        const double* source_y = tree.body_y.data();
+        const double* source_mass = tree.body_mass.data();
+        const double softening_squared = Gravitation::softening_squared();
+
+        for(std::int32_t i = target.first_body; i < target.first_body + target.body_count; i++){
+            const double x = tree.body_x[i];
+            const double y = tree.body_y[i];
+            double fx = 0.0;
+            double fy = 0.0;
+
+            // the body itself has distance 0 and is masked out
+            #pragma omp simd reduction(+:fx, fy)
+            for(std::int32_t j = source.first_body; j < source.first_body + source.body_count; j++){
+                double dx = source_x[j] - x;
+                double dy = source_y[j] - y;
+                double r_squared = dx * dx + dy * dy;
+                double inverse_r = inverse_distance<false>(r_squared, softening_squared);
+                double f = source_mass[j] * inverse_r * inverse_r * inverse_r;
+                fx += dx * f;
+                fy += dy * f;
+            }
+            sum_x[i] += fx;
+            sum_y[i] += fy;
+        }
+    }
+
+    void upward_pass(){
+        // deepest level first, children are complete before their parents
+        for(std::size_t level = level_begin.size() - 1; level > 0; level--){
+            #pragma omp parallel for schedule(dynamic, 16)
+            for(std::int32_t k = level_begin[level - 1]; k < level_begin[level]; k++){
+                if(tree.nodes[k].is_leaf()){
+                    particle_to_multipole(k);
+                }
+                else{
+                    multipole_to_multipole(k);
+                }
+            }
+        }
+    }
+
+    void downward_pass(){
+        for(std::size_t level = 0; level + 1 < level_begin.size(); level++){
+            #pragma omp parallel for schedule(dynamic, 16)
+            for(std::int32_t k = level_begin[level]; k < level_begin[level + 1]; k++){
+                const LinearQuadtreeNode& node = tree.nodes[k];
+                if(node.is_leaf()){
+                    local_to_particle(k);
+                }
+                for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++){
+                    local_to_local(k, c);
+                }
+            }
+        }
+    }
+
+    // dual tree traversal, only the expansions and bodies of the target subtree are written,
+    // so target subtrees can be processed by different tasks
+    void interact(std::int32_t target_index, std::int32_t source_index){
+        const LinearQuadtreeNode& target = tree.nodes[target_index];
+        const LinearQuadtreeNode& source = tree.nodes[source_index];
+
+        double dx = target.center_of_mass_x - source.center_of_mass_x;
+        double dy = target.center_of_mass_y - source.center_of_mass_y;
+        double radius_sum = radius[target_index] + radius[source_index];
+        if(target_index != source_index && radius_sum * radius_sum < theta_squared * (dx * dx + dy * dy)){
+            multipole_to_local(target_index, source_index);
+            return;
+        }
+        if(target.is_leaf() && source.is_leaf()){
+            particle_to_particle(target_index, source_index);
+            return;
+        }
+
+        bool split_target = !target.is_leaf() && (source.is_leaf() || radius[target_index] >= radius[source_index]);
+        if(!split_target){
+            for(std::int32_t c = source.first_child; c < source.first_child + source.child_count; c++){
+                interact(target_index, c);
+            }
+        }
+        else if(target.body_count > task_cutoff){
+            for(std::int32_t c = target.first_child; c < target.first_child + target.child_count; c++){
+                #pragma omp task firstprivate(c, source_index)
+                interact(c, source_index);
+            }
+            // the next source of this target must not run concurrently with these tasks
+            #pragma omp taskwait
+        }
+        else{
+            for(std::int32_t c = target.first_child; c < target.first_child + target.child_count; c++){
+                interact(c, source_index);
+            }
+        }
+    }
+
+    const LinearQuadtree& tree;
+    const std::int32_t p;
+    const std::int32_t num_coefficients;
+    const double theta_squared;
+
+    std::vector<double> inverse_factorial;
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+    std::vector<double> radius;    // all bodies of a node are within radius of its center of mass
+    std::vector<std::int32_t> level_begin;
+};
+
+void FastMultipoleSimulation::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    for(int i = 0; i < num_epochs; i++){
+        simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
+    }
+}
+
+void FastMultipoleSimulation::simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    Integrator::step(universe, [](Universe& u){
+        Quadtree qt = Quadtree(u, u.get_bounding_box(), 3, max_leaf_size);
+        calculate_forces(u, qt);
+    });
+
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots && (universe.current_simulation_epoch%plot_intermediate_epochs == 0)) {
+        plotter.add_bodies_to_image(universe);
+        plotter.write_and_clear();
+    }
+}
+
+void FastMultipoleSimulation::calculate_forces(Universe& universe, Quadtree& quadtree){
+    if(!quadtree.is_linear()){
+        throw std::invalid_argument("the fast multipole method requires a linear quadtree (construct mode 3)");
+    }
+    if(expansion_order < 1 || expansion_order > max_expansion_order){
+        throw std::invalid_argument("fmm expansion order must be between 1 and " + std::to_string(max_expansion_order));
+    }
+    if(threshold_theta <= 0 || threshold_theta >= 1){
+        throw std::invalid_argument("fmm theta must be between 0 and 1");
+    }
+
+    const LinearQuadtree& tree = quadtree.linear_quadtree;
+    FastMultipoleSolver solver(tree, static_cast<std::int32_t>(expansion_order), threshold_theta);
+    solver.solve();
+
+    const std::int32_t num_bodies = static_cast<std::int32_t>(tree.body_indices.size());
+    #pragma omp parallel for
+    for(std::int32_t s = 0; s < num_bodies; s++){
+        double scale = gravitational_constant * tree.body_mass[s];
+        universe.forces[tree.body_indices[s]] = Vector2d<double>(scale * solver.sum_x[s], scale * solver.sum_y[s]);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "structures/universe.h"
+#include "quadtree/quadtree.h"
+#include "plotting/plotter.h"
+
+// Fast Multipole Method on the linear quadtree: Cartesian Taylor expansions of 1/r,
+// multipole-to-local translations between well separated cells and direct summation between close leaves
+class FastMultipoleSimulation{
+public:
+    static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // quadtree has to be linear (construct_mode 3)
+    static void calculate_forces(Universe& universe, Quadtree& quadtree);
+
+    // order p of the multipole and local expansions
+    static inline std::uint32_t expansion_order = 4;
+    // maximum number of bodies in a leaf, leaves close to each other interact directly
+    static inline std::uint32_t max_leaf_size = 32;
+    // two cells interact through expansions if (radius_a + radius_b) < threshold_theta * distance
+    static inline double threshold_theta = 0.5;
+
+    static constexpr std::uint32_t max_expansion_order = 12;
+};
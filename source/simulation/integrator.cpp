@@ -0,0 +1,91 @@
+#include "simulation/integrator.h"
+#include "physics/gravitation.h"
+#include "physics/mechanics.h"
+
+#include <cmath>
+#include <omp.h>
+
+void Integrator::step(Universe& universe, const std::function<void(Universe&)>& calculate_forces){
+    switch(integrator){
+        case IntegratorType::leapfrog:
+            leapfrog_step(universe, calculate_forces, time_step);
+            break;
+        case IntegratorType::yoshida4: {
+            // w1, w0, w1 with 2 * w1 + w0 = 1 cancel the third order error of the leapfrog steps
+            const double cube_root_two = std::cbrt(2.0);
+            const double w1 = 1.0 / (2.0 - cube_root_two);
+            const double w0 = -cube_root_two / (2.0 - cube_root_two);
+            leapfrog_step(universe, calculate_forces, w1 * time_step);
+            leapfrog_step(universe, calculate_forces, w0 * time_step);
+            leapfrog_step(universe, calculate_forces, w1 * time_step);
+            break;
+        }
+        default:
+            evaluate_forces(universe, calculate_forces);
+            kick(universe, time_step);
+            drift(universe, time_step);
+            break;
+    }
+}
+
+void Integrator::leapfrog_step(Universe& universe, const std::function<void(Universe&)>& calculate_forces, double dt){
+    // the forces of the last kick belong to the current positions, consecutive steps share them
+    if(!universe.forces_current){
+        evaluate_forces(universe, calculate_forces);
+    }
+    kick(universe, dt / 2);
+    drift(universe, dt);
+    evaluate_forces(universe, calculate_forces);
+    kick(universe, dt / 2);
+}
+
+void Integrator::evaluate_forces(Universe& universe, const std::function<void(Universe&)>& calculate_forces){
+    calculate_forces(universe);
+    universe.forces_current = true;
+    force_evaluations++;
+}
+
+void Integrator::kick(Universe& universe, double dt){
+    #pragma omp parallel for
+    for(std::int64_t i = 0; i < static_cast<std::int64_t>(universe.num_bodies); i++){
+        Vector2d<double> acceleration = calculate_acceleration(universe.forces[i], universe.weights[i]);
+        universe.velocities[i] = calculate_velocity(universe.velocities[i], acceleration, dt);
+    }
+}
+
+void Integrator::drift(Universe& universe, double dt){
+    #pragma omp parallel for
+    for(std::int64_t i = 0; i < static_cast<std::int64_t>(universe.num_bodies); i++){
+        universe.positions[i] = universe.positions[i] + universe.velocities[i] * dt;
+    }
+    universe.forces_current = false;
+}
+
+double Integrator::total_energy(Universe& universe){
+    const std::int64_t num_bodies = universe.num_bodies;
+    const double softening_squared = Gravitation::softening_squared();
+    double energy = 0;
+    #pragma omp parallel for reduction(+:energy) schedule(dynamic, 64)
+    for(std::int64_t i = 0; i < num_bodies; i++){
+        const Vector2d<double>& velocity = universe.velocities[i];
+        energy += 0.5 * universe.weights[i] * (velocity[0] * velocity[0] + velocity[1] * velocity[1]);
+        for(std::int64_t j = i + 1; j < num_bodies; j++){
+            Vector2d<double> connect = universe.positions[j] - universe.positions[i];
+            // Plummer potential, matches the softened force
+            energy -= gravitational_constant * universe.weights[i] * universe.weights[j] / std::sqrt(connect[0] * connect[0] + connect[1] * connect[1] + softening_squared);
+        }
+    }
+    return energy;
+}
+
+std::string get_integrator_name(IntegratorType type){
+    switch(type){
+        case IntegratorType::euler:
+            return "euler";
+        case IntegratorType::leapfrog:
+            return "leapfrog";
+        case IntegratorType::yoshida4:
+            return "yoshida4";
+    }
+    return "unknown";
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "structures/universe.h"
+#include "structures/bounding_box.h"
+#include "simulation/constants.h"
+#include "physics/mechanics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+enum class IntegratorType : std::uint8_t {
+    euler = 0,      // full kick, then full drift. first order, one force evaluation per step
+    leapfrog = 1,   // kick-drift-kick, second order and symplectic, one force evaluation per step
+    yoshida4 = 2    // three leapfrog steps with the Yoshida weights, fourth order, three force evaluations per step
+};
+
+// time integration of the array-of-structures simulations. calculate_forces fills universe.forces for the current positions,
+// the simulations pass their force calculation (including the tree construction) in
+class Integrator{
+public:
+    // advances the universe by time_step
+    static void step(Universe& universe, const std::function<void(Universe&)>& calculate_forces);
+
+    // v = v0 + F / m * dt
+    static void kick(Universe& universe, double dt);
+    // p = p0 + v * dt
+    static void drift(Universe& universe, double dt);
+
+    // kinetic and potential energy of the system, all pairs. used to measure the error of the integrators
+    static double total_energy(Universe& universe);
+
+    static inline IntegratorType integrator = IntegratorType::euler;
+    // simulated seconds per epoch
+    static inline double time_step = epoch_in_seconds;
+    static inline std::uint64_t force_evaluations = 0;
+
+private:
+    static void leapfrog_step(Universe& universe, const std::function<void(Universe&)>& calculate_forces, double dt);
+    static void evaluate_forces(Universe& universe, const std::function<void(Universe&)>& calculate_forces);
+};
+
+// euler kick and drift of a single body right after its force is known, used by the fused epoch kernels.
+// call operator() from inside a parallel region, the bounding box of the new positions is reduced per thread
+class FusedEulerUpdate{
+public:
+    // new_positions may be universe.positions if the force calculation does not read the positions of other bodies
+    FusedEulerUpdate(Universe& universe, Vector2d<double>* new_positions, double dt)
+        : universe(universe), new_positions(new_positions), dt(dt), thread_boxes(omp_get_max_threads()) {}
+
+    void operator()(std::int32_t i, double fx, double fy){
+        Vector2d<double> acceleration = calculate_acceleration(Vector2d<double>(fx, fy), universe.weights[i]);
+        Vector2d<double> velocity = calculate_velocity(universe.velocities[i], acceleration, dt);
+        Vector2d<double> position = universe.positions[i] + velocity * dt;
+        universe.velocities[i] = velocity;
+        new_positions[i] = position;
+
+        ThreadBox& box = thread_boxes[omp_get_thread_num()];
+        box.x_min = std::min(box.x_min, position[0]);
+        box.x_max = std::max(box.x_max, position[0]);
+        box.y_min = std::min(box.y_min, position[1]);
+        box.y_max = std::max(box.y_max, position[1]);
+    }
+
+    // same result as Universe::get_bounding_box on the new positions
+    [[nodiscard]] BoundingBox get_bounding_box() const {
+        BoundingBox bb(std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest());
+        for(const ThreadBox& box : thread_boxes){
+            bb.x_min = std::min(bb.x_min, box.x_min);
+            bb.x_max = std::max(bb.x_max, box.x_max);
+            bb.y_min = std::min(bb.y_min, box.y_min);
+            bb.y_max = std::max(bb.y_max, box.y_max);
+        }
+        return bb;
+    }
+
+private:
+    // one cache line per thread
+    struct alignas(64) ThreadBox {
+        double x_min = std::numeric_limits<double>::max();
+        double x_max = std::numeric_limits<double>::lowest();
+        double y_min = std::numeric_limits<double>::max();
+        double y_max = std::numeric_limits<double>::lowest();
+    };
+
+    Universe& universe;
+    Vector2d<double>* new_positions;
+    double dt;
+    std::vector<ThreadBox> thread_boxes;
+};
+
+[[nodiscard]] std::string get_integrator_name(IntegratorType type);
@@ -0,0 +1,212 @@
+#include "simulation/naive_force_kernels.h"
+#include "physics/gravitation.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NAIVE_FORCE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+static void naive_force_row_scalar(const double* position_x, const double* position_y, const double* weights, std::int32_t num_bodies, std::int32_t i, double* force_x, double* force_y){
+    const double x = position_x[i];
+    const double y = position_y[i];
+    const double softening_squared = Gravitation::softening_squared();
+    const bool fast = Gravitation::fast_inverse_sqrt;
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+
+    for(std::int32_t j = 0; j < num_bodies; j++){
+        double dx = position_x[j] - x;
+        double dy = position_y[j] - y;
+        double d_squared = dx * dx + dy * dy;
+        if(d_squared > 0.0){
+            double inverse_d = inverse_distance(d_squared, softening_squared, fast);
+            double f = weights[j] * inverse_d * inverse_d * inverse_d;
+            sum_x += dx * f;
+            sum_y += dy * f;
+        }
+    }
+
+    // F = G * m_i * sum(m_j * d / |d|^3)
+    const double scale = gravitational_constant * weights[i];
+    force_x[i] = scale * sum_x;
+    force_y[i] = scale * sum_y;
+}
+
+#ifdef NAIVE_FORCE_KERNELS_X86
+
+// fast_inverse_sqrt on four lanes
+__attribute__((target("avx2,fma")))
+static inline __m256d fast_inverse_sqrt_avx2(__m256d x){
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    __m256i bits = _mm256_sub_epi64(_mm256_set1_epi64x(0x5FE6EB50C7B537A9ll), _mm256_srli_epi64(_mm256_castpd_si256(x), 1));
+    __m256d y = _mm256_castsi256_pd(bits);
+    __m256d half_x = _mm256_mul_pd(_mm256_set1_pd(0.5), x);
+    for(int step = 0; step < 3; step++){
+        y = _mm256_mul_pd(y, _mm256_fnmadd_pd(_mm256_mul_pd(half_x, y), y, three_halves));
+    }
+    return y;
+}
+
+__attribute__((target("avx2,fma")))
+static void naive_force_row_avx2(const double* position_x, const double* position_y, const double* weights, std::int32_t num_bodies, std::int32_t i, double* force_x, double* force_y){
+    const double x = position_x[i];
+    const double y = position_y[i];
+    const __m256d xi = _mm256_set1_pd(x);
+    const __m256d yi = _mm256_set1_pd(y);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const double softening_squared = Gravitation::softening_squared();
+    const __m256d softening_squared_vector = _mm256_set1_pd(softening_squared);
+    const bool fast = Gravitation::fast_inverse_sqrt;
+    __m256d sum_x_vector = zero;
+    __m256d sum_y_vector = zero;
+
+    // four interactions per iteration
+    std::int32_t j = 0;
+    for(; j + 4 <= num_bodies; j += 4){
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(position_x + j), xi);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(position_y + j), yi);
+        __m256d d_squared = _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx));
+        __m256d softened_squared = _mm256_add_pd(d_squared, softening_squared_vector);
+        __m256d inverse_d = fast ? fast_inverse_sqrt_avx2(softened_squared) : _mm256_div_pd(one, _mm256_sqrt_pd(softened_squared));
+        __m256d inverse_d_cubed = _mm256_mul_pd(_mm256_mul_pd(inverse_d, inverse_d), inverse_d);
+        __m256d f = _mm256_mul_pd(_mm256_loadu_pd(weights + j), inverse_d_cubed);
+        // mask out the self interaction (distance 0)
+        f = _mm256_and_pd(f, _mm256_cmp_pd(d_squared, zero, _CMP_GT_OQ));
+        sum_x_vector = _mm256_fmadd_pd(dx, f, sum_x_vector);
+        sum_y_vector = _mm256_fmadd_pd(dy, f, sum_y_vector);
+    }
+
+    alignas(32) double lanes_x[4];
+    alignas(32) double lanes_y[4];
+    _mm256_store_pd(lanes_x, sum_x_vector);
+    _mm256_store_pd(lanes_y, sum_y_vector);
+    double sum_x = (lanes_x[0] + lanes_x[1]) + (lanes_x[2] + lanes_x[3]);
+    double sum_y = (lanes_y[0] + lanes_y[1]) + (lanes_y[2] + lanes_y[3]);
+
+    // remaining bodies
+    for(; j < num_bodies; j++){
+        double dx = position_x[j] - x;
+        double dy = position_y[j] - y;
+        double d_squared = dx * dx + dy * dy;
+        if(d_squared > 0.0){
+            double inverse_d = inverse_distance(d_squared, softening_squared, fast);
+            double f = weights[j] * inverse_d * inverse_d * inverse_d;
+            sum_x += dx * f;
+            sum_y += dy * f;
+        }
+    }
+
+    const double scale = gravitational_constant * weights[i];
+    force_x[i] = scale * sum_x;
+    force_y[i] = scale * sum_y;
+}
+
+__attribute__((target("avx512f")))
+static void naive_force_row_avx512(const double* position_x, const double* position_y, const double* weights, std::int32_t num_bodies, std::int32_t i, double* force_x, double* force_y){
+    const __m512d xi = _mm512_set1_pd(position_x[i]);
+    const __m512d yi = _mm512_set1_pd(position_y[i]);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d softening_squared_vector = _mm512_set1_pd(Gravitation::softening_squared());
+    const bool fast = Gravitation::fast_inverse_sqrt;
+    __m512d sum_x_vector = zero;
+    __m512d sum_y_vector = zero;
+
+    // eight interactions per iteration, the tail is handled with masked loads
+    for(std::int32_t j = 0; j < num_bodies; j += 8){
+        std::int32_t remaining = num_bodies - j;
+        __mmask8 load_mask = remaining >= 8 ? static_cast<__mmask8>(0xFF) : static_cast<__mmask8>((1u << remaining) - 1);
+
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(load_mask, position_x + j), xi);
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(load_mask, position_y + j), yi);
+        __m512d d_squared = _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx));
+        __m512d softened_squared = _mm512_add_pd(d_squared, softening_squared_vector);
+        __m512d inverse_d;
+        if(fast){
+            // 14 bit estimate, two Newton steps reach double precision
+            __m512d half_x = _mm512_mul_pd(_mm512_set1_pd(0.5), softened_squared);
+            inverse_d = _mm512_rsqrt14_pd(softened_squared);
+            inverse_d = _mm512_mul_pd(inverse_d, _mm512_fnmadd_pd(_mm512_mul_pd(half_x, inverse_d), inverse_d, three_halves));
+            inverse_d = _mm512_mul_pd(inverse_d, _mm512_fnmadd_pd(_mm512_mul_pd(half_x, inverse_d), inverse_d, three_halves));
+        }
+        else{
+            inverse_d = _mm512_div_pd(one, _mm512_sqrt_pd(softened_squared));
+        }
+        __m512d inverse_d_cubed = _mm512_mul_pd(_mm512_mul_pd(inverse_d, inverse_d), inverse_d);
+        // mask out the self interaction (distance 0) and the lanes behind the last body
+        __mmask8 valid = _mm512_mask_cmp_pd_mask(load_mask, d_squared, zero, _CMP_GT_OQ);
+        __m512d f = _mm512_maskz_mul_pd(valid, _mm512_maskz_loadu_pd(load_mask, weights + j), inverse_d_cubed);
+        sum_x_vector = _mm512_fmadd_pd(dx, f, sum_x_vector);
+        sum_y_vector = _mm512_fmadd_pd(dy, f, sum_y_vector);
+    }
+
+    const double scale = gravitational_constant * weights[i];
+    force_x[i] = scale * _mm512_reduce_add_pd(sum_x_vector);
+    force_y[i] = scale * _mm512_reduce_add_pd(sum_y_vector);
+}
+
+#endif
+
+bool naive_force_kernel_available(NaiveForceKernelType type){
+    switch(type){
+        case NaiveForceKernelType::automatic:
+        case NaiveForceKernelType::scalar:
+            return true;
+#ifdef NAIVE_FORCE_KERNELS_X86
+        case NaiveForceKernelType::avx2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case NaiveForceKernelType::avx512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+NaiveForceRowKernel get_naive_force_kernel(NaiveForceKernelType type){
+    if(type == NaiveForceKernelType::automatic){
+        if(naive_force_kernel_available(NaiveForceKernelType::avx512)){
+            type = NaiveForceKernelType::avx512;
+        }
+        else if(naive_force_kernel_available(NaiveForceKernelType::avx2)){
+            type = NaiveForceKernelType::avx2;
+        }
+        else{
+            type = NaiveForceKernelType::scalar;
+        }
+    }
+    if(!naive_force_kernel_available(type)){
+        throw std::invalid_argument("naive force kernel not supported on this cpu: " + get_naive_force_kernel_name(type));
+    }
+
+    switch(type){
+#ifdef NAIVE_FORCE_KERNELS_X86
+        case NaiveForceKernelType::avx2:
+            return naive_force_row_avx2;
+        case NaiveForceKernelType::avx512:
+            return naive_force_row_avx512;
+#endif
+        default:
+            return naive_force_row_scalar;
+    }
+}
+
+std::string get_naive_force_kernel_name(NaiveForceKernelType type){
+    switch(type){
+        case NaiveForceKernelType::automatic:
+            return "automatic";
+        case NaiveForceKernelType::scalar:
+            return "scalar";
+        case NaiveForceKernelType::avx2:
+            return "avx2";
+        case NaiveForceKernelType::avx512:
+            return "avx512";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// computes the force on body i from all other bodies, inputs are structure-of-arrays buffers
+using NaiveForceRowKernel = void (*)(const double* position_x, const double* position_y, const double* weights, std::int32_t num_bodies, std::int32_t i, double* force_x, double* force_y);
+
+enum class NaiveForceKernelType : std::uint8_t {
+    automatic = 0,  // widest instruction set supported by the cpu
+    scalar = 1,
+    avx2 = 2,
+    avx512 = 3
+};
+
+// true if the kernel was compiled in and the cpu supports it
+[[nodiscard]] bool naive_force_kernel_available(NaiveForceKernelType type);
+
+// throws std::invalid_argument if the kernel is not available
+[[nodiscard]] NaiveForceRowKernel get_naive_force_kernel(NaiveForceKernelType type);
+
+[[nodiscard]] std::string get_naive_force_kernel_name(NaiveForceKernelType type);
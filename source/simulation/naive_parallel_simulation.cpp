@@ -1,6 +1,7 @@
 #include "simulation/naive_parallel_simulation.h"
 #include "physics/gravitation.h"
 #include "physics/mechanics.h"
+#include "simulation/integrator.h"
 
 #include <cmath>
 //hab ich hinzugefügt
@@ -8,15 +9,32 @@
 #include <iostream>
 
 void NaiveParallelSimulation::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    // position buffer of the fused epochs, kept between the epochs
+    std::vector<Vector2d<double>> next_positions;
     for(int i = 0; i < num_epochs; i++){
-        simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
+        simulate_epoch(plotter, universe, next_positions, create_intermediate_plots, plot_intermediate_epochs);
     }
 }
 
 void NaiveParallelSimulation::simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
-    calculate_forces(universe);
-    calculate_velocities(universe);
-    calculate_positions(universe);
+    std::vector<Vector2d<double>> next_positions;
+    simulate_epoch(plotter, universe, next_positions, create_intermediate_plots, plot_intermediate_epochs);
+}
+
+void NaiveParallelSimulation::simulate_epoch(Plotter& plotter, Universe& universe, std::vector<Vector2d<double>>& next_positions, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    if(fused_epoch && Integrator::integrator == IntegratorType::euler){
+        calculate_forces_fused(universe, next_positions);
+    }
+    else{
+        Integrator::step(universe, [](Universe& u){
+            if(use_simd_kernel){
+                calculate_forces_simd(u);
+            }
+            else{
+                calculate_forces(u);
+            }
+        });
+    }
     universe.current_simulation_epoch++;
     if(create_intermediate_plots){
         if(universe.current_simulation_epoch % plot_intermediate_epochs == 0){
@@ -27,21 +45,112 @@ void NaiveParallelSimulation::simulate_epoch(Plotter& plotter, Universe& univers
 }
 
 
+// force on body i from all other bodies
+// fast_inverse_sqrt: branch free over all j, the body itself drops out by its distance 0
+static Vector2d<double> naive_force_fast(const Universe& universe, int i) {
+    const double softening_squared = Gravitation::softening_squared();
+    const double x = universe.positions[i][0];
+    const double y = universe.positions[i][1];
+    double sum_x = 0.0;
+    double sum_y = 0.0;
+
+#pragma omp simd reduction(+:sum_x, sum_y)
+    for (int j = 0; j < universe.num_bodies; j++) {
+        double dx = universe.positions[j][0] - x;
+        double dy = universe.positions[j][1] - y;
+        double inverse_d = inverse_distance<true>(dx * dx + dy * dy, softening_squared);
+        double f = universe.weights[j] * inverse_d * inverse_d * inverse_d;
+        sum_x += dx * f;
+        sum_y += dy * f;
+    }
+    const double scale = gravitational_constant * universe.weights[i];
+    return Vector2d<double>(scale * sum_x, scale * sum_y);
+}
+
+static Vector2d<double> naive_force(const Universe& universe, int i) {
+    if (Gravitation::fast_inverse_sqrt) {
+        return naive_force_fast(universe, i);
+    }
+    Vector2d<double> f(0.0, 0.0);
+
+    for (int j = 0; j < universe.num_bodies; j++) {
+        if (i == j) continue; //Eigeneabhängigkeit ist unnötig
+
+        //Verbindungsvektor
+        Vector2d<double> connect = universe.positions[j] - universe.positions[i];
+        double d = connect.norm();
+
+        f = f + connect / d * gravitational_force(universe.weights[i], universe.weights[j], d);
+    }
+    return f;
+}
+
 void NaiveParallelSimulation::calculate_forces(Universe &universe) {
     #pragma omp parallel for
     for (int i = 0; i < universe.num_bodies; i++) {
-        Vector2d<double> f(0.0, 0.0);
+        universe.forces[i] = naive_force(universe, i);
+    }
+}
+
 
-        for (int j = 0; j < universe.num_bodies; j++) {
-            if (i == j) continue; //Eigeneabhängigkeit ist unnötig
+void NaiveParallelSimulation::calculate_forces_fused(Universe &universe, std::vector<Vector2d<double>>& next_positions) {
+    const std::int32_t num_bodies = universe.num_bodies;
 
-            //Verbindungsvektor
-            Vector2d<double> connect = universe.positions[j] - universe.positions[i];
-            double d = connect.norm();
+    if(use_simd_kernel){
+        NaiveForceRowKernel kernel = get_naive_force_kernel(force_kernel);
+        // the kernels read the coordinate copies, so the positions can be updated in place
+        aligned_vector<double> position_x(num_bodies);
+        aligned_vector<double> position_y(num_bodies);
+        aligned_vector<double> force_x(num_bodies);
+        aligned_vector<double> force_y(num_bodies);
+        #pragma omp parallel for
+        for (std::int32_t i = 0; i < num_bodies; i++) {
+            position_x[i] = universe.positions[i][0];
+            position_y[i] = universe.positions[i][1];
+        }
 
-            f = f + connect / d * gravitational_force(universe.weights[i], universe.weights[j], d);
+        FusedEulerUpdate update(universe, universe.positions.data(), Integrator::time_step);
+        #pragma omp parallel for schedule(static)
+        for (std::int32_t i = 0; i < num_bodies; i++) {
+            kernel(position_x.data(), position_y.data(), universe.weights.data(), num_bodies, i, force_x.data(), force_y.data());
+            update(i, force_x[i], force_y[i]);
+        }
+    }
+    else{
+        // the other rows still need the old positions, the new ones are swapped in after the loop
+        next_positions.resize(num_bodies);
+        FusedEulerUpdate update(universe, next_positions.data(), Integrator::time_step);
+        #pragma omp parallel for
+        for (int i = 0; i < num_bodies; i++) {
+            Vector2d<double> f = naive_force(universe, i);
+            update(i, f[0], f[1]);
         }
-        universe.forces[i] = f;
+        universe.positions.swap(next_positions);
+    }
+    universe.forces_current = false;
+    Integrator::force_evaluations++;
+}
+
+
+void NaiveParallelSimulation::calculate_forces_simd(Universe &universe) {
+    const std::int32_t num_bodies = universe.num_bodies;
+    NaiveForceRowKernel kernel = get_naive_force_kernel(force_kernel);
+
+    // the kernels work on contiguous coordinate arrays
+    aligned_vector<double> position_x(num_bodies);
+    aligned_vector<double> position_y(num_bodies);
+    aligned_vector<double> force_x(num_bodies);
+    aligned_vector<double> force_y(num_bodies);
+    #pragma omp parallel for
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        position_x[i] = universe.positions[i][0];
+        position_y[i] = universe.positions[i][1];
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        kernel(position_x.data(), position_y.data(), universe.weights.data(), num_bodies, i, force_x.data(), force_y.data());
+        universe.forces[i] = Vector2d<double>(force_x[i], force_y[i]);
     }
 }
 
@@ -68,8 +177,6 @@ void NaiveParallelSimulation::calculate_velocities(Universe &universe) {
 }
 
 void NaiveParallelSimulation::calculate_positions(Universe &universe) {
-    calculate_velocities(universe);
-
     #pragma omp parallel for
     for (int i = 0; i < universe.num_bodies; i++) {
         Vector2d<double> ds = universe.velocities[i] * epoch_in_seconds;
@@ -77,3 +184,103 @@ void NaiveParallelSimulation::calculate_positions(Universe &universe) {
         universe.positions[i] = universe.positions[i] + ds;
     }
 }
+
+
+void NaiveParallelSimulation::simulate_epochs(Plotter& plotter, UniverseSoA& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    for(int i = 0; i < num_epochs; i++){
+        simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
+    }
+}
+
+void NaiveParallelSimulation::simulate_epoch(Plotter& plotter, UniverseSoA& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    if(use_simd_kernel){
+        calculate_forces_simd(universe);
+    }
+    else{
+        calculate_forces(universe);
+    }
+    calculate_velocities(universe);
+    calculate_positions(universe);
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots){
+        if(universe.current_simulation_epoch % plot_intermediate_epochs == 0){
+            plotter.add_bodies_to_image(universe);
+            plotter.write_and_clear();
+        }
+    }
+}
+
+// force on body i of the structure-of-arrays universe
+template <bool fast>
+static void soa_force_row(const double* position_x, const double* position_y, const double* weights, std::int32_t num_bodies, std::int32_t i, double softening_squared, double& force_x, double& force_y) {
+    const double x = position_x[i];
+    const double y = position_y[i];
+    const double m = weights[i];
+    double fx = 0.0;
+    double fy = 0.0;
+
+    // branch free inner loop, the self interaction has distance 0 and is masked out
+    #pragma omp simd reduction(+:fx, fy)
+    for (std::int32_t j = 0; j < num_bodies; j++) {
+        double dx = position_x[j] - x;
+        double dy = position_y[j] - y;
+        double d_squared = dx * dx + dy * dy;
+        double inverse_d = inverse_distance<fast>(d_squared, softening_squared);
+        double f = gravitational_constant * m * weights[j] * inverse_d * inverse_d * inverse_d;
+        fx += dx * f;
+        fy += dy * f;
+    }
+    force_x = fx;
+    force_y = fy;
+}
+
+void NaiveParallelSimulation::calculate_forces(UniverseSoA &universe) {
+    const std::int32_t num_bodies = universe.num_bodies;
+    const double softening_squared = Gravitation::softening_squared();
+    auto force_row = Gravitation::fast_inverse_sqrt ? soa_force_row<true> : soa_force_row<false>;
+
+    #pragma omp parallel for schedule(static)
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        force_row(universe.positions.x.data(), universe.positions.y.data(), universe.weights.data(), num_bodies, i, softening_squared, universe.forces.x[i], universe.forces.y[i]);
+    }
+}
+
+void NaiveParallelSimulation::calculate_forces_simd(UniverseSoA &universe) {
+    const std::int32_t num_bodies = universe.num_bodies;
+    NaiveForceRowKernel kernel = get_naive_force_kernel(force_kernel);
+
+    #pragma omp parallel for schedule(static)
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        kernel(universe.positions.x.data(), universe.positions.y.data(), universe.weights.data(), num_bodies, i, universe.forces.x.data(), universe.forces.y.data());
+    }
+}
+
+void NaiveParallelSimulation::calculate_velocities(UniverseSoA &universe) {
+    const std::int32_t num_bodies = universe.num_bodies;
+    const double* force_x = universe.forces.x.data();
+    const double* force_y = universe.forces.y.data();
+    const double* weights = universe.weights.data();
+    double* velocity_x = universe.velocities.x.data();
+    double* velocity_y = universe.velocities.y.data();
+
+    // v = v0 + F / m * t
+    #pragma omp parallel for simd
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        velocity_x[i] += force_x[i] / weights[i] * epoch_in_seconds;
+        velocity_y[i] += force_y[i] / weights[i] * epoch_in_seconds;
+    }
+}
+
+void NaiveParallelSimulation::calculate_positions(UniverseSoA &universe) {
+    const std::int32_t num_bodies = universe.num_bodies;
+    const double* velocity_x = universe.velocities.x.data();
+    const double* velocity_y = universe.velocities.y.data();
+    double* position_x = universe.positions.x.data();
+    double* position_y = universe.positions.y.data();
+
+    #pragma omp parallel for simd
+    for (std::int32_t i = 0; i < num_bodies; i++) {
+        position_x[i] += velocity_x[i] * epoch_in_seconds;
+        position_y[i] += velocity_y[i] * epoch_in_seconds;
+    }
+}
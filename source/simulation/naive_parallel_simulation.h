@@ -2,13 +2,36 @@
 
 
 #include "structures/universe.h"
+#include "structures/universe_soa.h"
 #include "plotting/plotter.h"
+#include "simulation/naive_force_kernels.h"
 
 class NaiveParallelSimulation{
 public:
     static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
     static void simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    // next_positions is the buffer of the fused epoch, it can be kept between the calls
+    static void simulate_epoch(Plotter& plotter, Universe& universe, std::vector<Vector2d<double>>& next_positions, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
     static void calculate_velocities(Universe& universe);
     static void calculate_positions(Universe& universe);
     static void calculate_forces(Universe& universe);
+    // fused euler epoch: the kick and drift of a body follow its force in the same parallel loop. the new positions are
+    // written to next_positions and swapped in afterwards (in place with use_simd_kernel), universe.forces is not written
+    static void calculate_forces_fused(Universe& universe, std::vector<Vector2d<double>>& next_positions);
+    // explicitly vectorized kernel, see naive_force_kernels.h
+    static void calculate_forces_simd(Universe& universe);
+
+    // structure-of-arrays variants
+    static void simulate_epochs(Plotter& plotter, UniverseSoA& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void simulate_epoch(Plotter& plotter, UniverseSoA& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void calculate_velocities(UniverseSoA& universe);
+    static void calculate_positions(UniverseSoA& universe);
+    static void calculate_forces(UniverseSoA& universe);
+    static void calculate_forces_simd(UniverseSoA& universe);
+
+    // simulate_epoch uses calculate_forces_simd with the selected kernel if set
+    static inline bool use_simd_kernel = false;
+    static inline NaiveForceKernelType force_kernel = NaiveForceKernelType::automatic;
+    // simulate_epoch with the euler integrator uses calculate_forces_fused if set
+    static inline bool fused_epoch = false;
 };
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "simulation/naive_tiled_simulation.h"
+#include "simulation/naive_parallel_simulation.h"
+#include "simulation/integrator.h"
+#include "structures/universe_soa.h"
+#include "physics/gravitation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+void NaiveTiledSimulation::simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    for(int i = 0; i < num_epochs; i++){
+        simulate_epoch(plotter, universe, create_intermediate_plots, plot_intermediate_epochs);
+    }
+}
+
+void NaiveTiledSimulation::simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs){
+    Integrator::step(universe, calculate_forces);
+    universe.current_simulation_epoch++;
+    if(create_intermediate_plots){
+        if(universe.current_simulation_epoch % plot_intermediate_epochs == 0){
+            plotter.add_bodies_to_image(universe);
+            plotter.write_and_clear();
+        }
+    }
+}
+
+// interactions of body i with the bodies [j_begin, j_end), the reaction is subtracted from the j accumulators
+template <bool fast>
+static inline void accumulate_pairs(const double* position_x, const double* position_y, const double* weights, std::int32_t i, std::int32_t j_begin, std::int32_t j_end, double* force_x, double* force_y){
+    const double x = position_x[i];
+    const double y = position_y[i];
+    const double gm = gravitational_constant * weights[i];
+    const double softening_squared = Gravitation::softening_squared();
+    double fx = 0.0;
+    double fy = 0.0;
+
+    // every j is written once per iteration, so the loop vectorizes
+    #pragma omp simd reduction(+:fx, fy)
+    for(std::int32_t j = j_begin; j < j_end; j++){
+        double dx = position_x[j] - x;
+        double dy = position_y[j] - y;
+        double d_squared = dx * dx + dy * dy;
+        double inverse_d = inverse_distance<fast>(d_squared, softening_squared);
+        double f = gm * weights[j] * inverse_d * inverse_d * inverse_d;
+        fx += dx * f;
+        fy += dy * f;
+        force_x[j] -= dx * f;
+        force_y[j] -= dy * f;
+    }
+    force_x[i] += fx;
+    force_y[i] += fy;
+}
+
+void NaiveTiledSimulation::calculate_forces(Universe& universe){
+    const std::int32_t num_bodies = universe.num_bodies;
+    const std::int32_t tile = std::max<std::int32_t>(tile_size, 1);
+    const std::int32_t num_tiles = (num_bodies + tile - 1) / tile;
+
+    aligned_vector<double> position_x(num_bodies);
+    aligned_vector<double> position_y(num_bodies);
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < num_bodies; i++){
+        position_x[i] = universe.positions[i][0];
+        position_y[i] = universe.positions[i][1];
+    }
+    const double* weights = universe.weights.data();
+    // the force law is chosen once, the inner loops stay branch free
+    auto accumulate = Gravitation::fast_inverse_sqrt ? accumulate_pairs<true> : accumulate_pairs<false>;
+
+    // upper triangle of the tile matrix including the diagonal
+    std::vector<std::pair<std::int32_t, std::int32_t>> tile_pairs;
+    tile_pairs.reserve(static_cast<std::size_t>(num_tiles) * (num_tiles + 1) / 2);
+    for(std::int32_t a = 0; a < num_tiles; a++){
+        for(std::int32_t b = a; b < num_tiles; b++){
+            tile_pairs.emplace_back(a, b);
+        }
+    }
+    const std::int32_t num_tile_pairs = static_cast<std::int32_t>(tile_pairs.size());
+
+    const std::int32_t num_threads = omp_get_max_threads();
+    std::vector<aligned_vector<double>> thread_force_x(num_threads);
+    std::vector<aligned_vector<double>> thread_force_y(num_threads);
+
+    #pragma omp parallel
+    {
+        // every thread accumulates into its own force arrays, no synchronization inside the tiles
+        const std::int32_t thread_id = omp_get_thread_num();
+        aligned_vector<double>& force_x = thread_force_x[thread_id];
+        aligned_vector<double>& force_y = thread_force_y[thread_id];
+        force_x.assign(num_bodies, 0.0);
+        force_y.assign(num_bodies, 0.0);
+
+        #pragma omp for schedule(dynamic, 1)
+        for(std::int32_t p = 0; p < num_tile_pairs; p++){
+            const std::int32_t i_begin = tile_pairs[p].first * tile;
+            const std::int32_t i_end = std::min(i_begin + tile, num_bodies);
+            const std::int32_t j_begin = tile_pairs[p].second * tile;
+            const std::int32_t j_end = std::min(j_begin + tile, num_bodies);
+
+            for(std::int32_t i = i_begin; i < i_end; i++){
+                // diagonal tile: only pairs j > i
+                accumulate(position_x.data(), position_y.data(), weights, i, i_begin == j_begin ? i + 1 : j_begin, j_end, force_x.data(), force_y.data());
+            }
+        }
+
+        // sum up the thread accumulators (implicit barrier of the loop above)
+        #pragma omp for schedule(static)
+        for(std::int32_t i = 0; i < num_bodies; i++){
+            double fx = 0.0;
+            double fy = 0.0;
+            for(std::int32_t t = 0; t < num_threads; t++){
+                if(!thread_force_x[t].empty()){
+                    fx += thread_force_x[t][i];
+                    fy += thread_force_y[t][i];
+                }
+            }
+            universe.forces[i] = Vector2d<double>(fx, fy);
+        }
+    }
+}
+
+void NaiveTiledSimulation::calculate_velocities(Universe& universe){
+    NaiveParallelSimulation::calculate_velocities(universe);
+}
+
+void NaiveTiledSimulation::calculate_positions(Universe& universe){
+    NaiveParallelSimulation::calculate_positions(universe);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "structures/universe.h"
+#include "plotting/plotter.h"
+
+// all-pairs simulation on cache sized tiles, every pair is evaluated once and applied to both bodies
+class NaiveTiledSimulation{
+public:
+    static void simulate_epochs(Plotter& plotter, Universe& universe, std::uint32_t num_epochs, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void simulate_epoch(Plotter& plotter, Universe& universe, bool create_intermediate_plots, std::uint32_t plot_intermediate_epochs);
+    static void calculate_forces(Universe& universe);
+    static void calculate_velocities(Universe& universe);
+    static void calculate_positions(Universe& universe);
+
+    // bodies per tile, two tiles of positions and weights (2 * 3 * 8 byte per body) should fit into L1/L2
+    static inline std::int32_t tile_size = 512;
+};
@@ -4,10 +4,13 @@
 #include "image/pixel.h"
 #include <ctime>
 
+#include <algorithm>
 #include <cstdint>
 #include <random>
 #include <tuple>
 #include <set>
+#include <stdexcept>
+#include <string>
 #include <omp.h>
 #include <cmath>
 
@@ -21,11 +24,81 @@ void Universe::print_bodies_to_console(){
     }
 }
 
+void Universe::assign_body_ids(){
+    if(body_ids.size() == num_bodies){
+        return;
+    }
+    body_ids.resize(num_bodies);
+    for(std::uint32_t i = 0; i < num_bodies; i++){
+        body_ids[i] = i;
+    }
+    update_body_slots();
+}
+
+void Universe::apply_permutation(const std::vector<std::int32_t>& order){
+    const bool has_body_ids = body_ids.size() == num_bodies;
+    std::vector<double> permuted_weights(num_bodies);
+    std::vector<Vector2d<double>> permuted_forces(num_bodies);
+    std::vector<Vector2d<double>> permuted_velocities(num_bodies);
+    std::vector<Vector2d<double>> permuted_positions(num_bodies);
+    std::vector<std::uint64_t> permuted_body_ids(has_body_ids ? num_bodies : 0);
+    #pragma omp parallel for
+    for(std::int64_t i = 0; i < static_cast<std::int64_t>(num_bodies); i++){
+        std::int32_t body_index = order[i];
+        permuted_weights[i] = weights[body_index];
+        permuted_forces[i] = forces[body_index];
+        permuted_velocities[i] = velocities[body_index];
+        permuted_positions[i] = positions[body_index];
+        if(has_body_ids){
+            permuted_body_ids[i] = body_ids[body_index];
+        }
+    }
+    weights = std::move(permuted_weights);
+    forces = std::move(permuted_forces);
+    velocities = std::move(permuted_velocities);
+    positions = std::move(permuted_positions);
+    if(has_body_ids){
+        body_ids = std::move(permuted_body_ids);
+        update_body_slots();
+    }
+}
+
+void Universe::update_body_slots(){
+    std::uint64_t max_id = 0;
+    for(auto body_id : body_ids){
+        max_id = std::max(max_id, body_id);
+    }
+    body_slots.clear();
+    sparse_body_slots.clear();
+    if(body_ids.empty()){
+        return;
+    }
+
+    // the ids of assign_body_ids stay below the initial body count, collisions only remove some of them.
+    // arbitrary ids from a file go to the hash map instead of a table of size max_id + 1
+    if(max_id >= 8 * static_cast<std::uint64_t>(body_ids.size()) + 1024){
+        sparse_body_slots.reserve(body_ids.size());
+        for(std::int64_t i = 0; i < static_cast<std::int64_t>(body_ids.size()); i++){
+            if(!sparse_body_slots.emplace(body_ids[i], i).second){
+                throw std::invalid_argument("Duplicate body id " + std::to_string(body_ids[i]) + "!");
+            }
+        }
+        return;
+    }
+
+    // the ids are unique, see load_universe, so every slot is written by one thread
+    body_slots.assign(max_id + 1, -1);
+    #pragma omp parallel for
+    for(std::int64_t i = 0; i < static_cast<std::int64_t>(body_ids.size()); i++){
+        body_slots[body_ids[i]] = i;
+    }
+}
+
 BoundingBox Universe::get_bounding_box(){
     double x_min = std::numeric_limits<double>::max();
-    double x_max = std::numeric_limits<double>::min();
+    double x_max = std::numeric_limits<double>::lowest();
     double y_min = std::numeric_limits<double>::max();;
-    double y_max = std::numeric_limits<double>::min();;
+    double y_max = std::numeric_limits<double>::lowest();;
 
     for(auto position: positions){
         double pos_x, pos_y;
@@ -53,18 +126,18 @@ BoundingBox Universe::get_bounding_box(){
 BoundingBox Universe::parallel_cpu_get_bounding_box() {
     // Initialisieren der maximalen bzw. minimalen möglichen Werten
     double x_min = std::numeric_limits<double>::max();
-    double x_max = std::numeric_limits<double>::min();
+    double x_max = std::numeric_limits<double>::lowest();
     double y_min = std::numeric_limits<double>::max();
-    double y_max = std::numeric_limits<double>::min();
+    double y_max = std::numeric_limits<double>::lowest();
 
     //Nun starten wir eine Parallelisierung
     #pragma omp parallel
     {
         //Jeder Thread enthält eine lokale Kopie der Variablen
         double local_x_min = std::numeric_limits<double>::max();
-        double local_x_max = std::numeric_limits<double>::min();
+        double local_x_max = std::numeric_limits<double>::lowest();
         double local_y_min = std::numeric_limits<double>::max();
-        double local_y_max = std::numeric_limits<double>::min();
+        double local_y_max = std::numeric_limits<double>::lowest();
 
         //Jetzt machen wir eine parallele Schleife
         #pragma omp for nowait
@@ -1,8 +1,10 @@
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <iostream>
 
 #include <limits>
+#include <unordered_map>
 #include <filesystem>
 
 #include "structures/vector2d.h"
@@ -19,12 +21,32 @@ public:
     BoundingBox get_bounding_box();
     BoundingBox parallel_cpu_get_bounding_box();
 
+    // gives every body its current slot as id, if the universe has no ids yet
+    void assign_body_ids();
+    // rebuilds the id -> slot index, needed after the bodies were reordered or removed
+    void update_body_slots();
+    // new slot i takes the body from slot order[i], all columns and the body ids are permuted
+    void apply_permutation(const std::vector<std::int32_t>& order);
+    // slot of the body with this id, -1 if the id is unknown or the body was absorbed. O(1), see update_body_slots
+    [[nodiscard]] std::int64_t get_body_slot(std::uint64_t body_id) const {
+        if(body_id < body_slots.size()){
+            return body_slots[body_id];
+        }
+        auto slot = sparse_body_slots.find(body_id);
+        return slot == sparse_body_slots.end() ? -1 : slot->second;
+    }
 
     std::uint32_t num_bodies;
     std::vector<double> weights;  // in kg
     std::vector<Vector2d<double>> forces; // in N
     std::vector<Vector2d<double>> velocities;  // in m/s
     std::vector<Vector2d<double>> positions;  // in m
+    // stable id of every body, moves with the body when the vectors are reordered or compacted. may be empty
+    std::vector<std::uint64_t> body_ids;
+    std::vector<std::int64_t> body_slots;  // indexed by body id
+    std::unordered_map<std::uint64_t, std::int64_t> sparse_body_slots;  // instead of body_slots if the ids are far larger than the body count
+    // forces belong to the current positions and weights, lets the leapfrog integrators reuse the forces of the last step
+    bool forces_current = false;
     std::uint32_t current_simulation_epoch;
 
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "structures/universe_soa.h"
+
+#include <limits>
+#include <omp.h>
+
+void UniverseSoA::load(Universe& universe){
+    num_bodies = universe.num_bodies;
+    current_simulation_epoch = universe.current_simulation_epoch;
+
+    weights.resize(num_bodies);
+    forces.resize(num_bodies);
+    velocities.resize(num_bodies);
+    positions.resize(num_bodies);
+
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < static_cast<std::int32_t>(num_bodies); i++){
+        weights[i] = universe.weights[i];
+        forces.x[i] = universe.forces[i][0];
+        forces.y[i] = universe.forces[i][1];
+        velocities.x[i] = universe.velocities[i][0];
+        velocities.y[i] = universe.velocities[i][1];
+        positions.x[i] = universe.positions[i][0];
+        positions.y[i] = universe.positions[i][1];
+    }
+}
+
+void UniverseSoA::store(Universe& universe){
+    universe.num_bodies = num_bodies;
+    universe.current_simulation_epoch = current_simulation_epoch;
+
+    universe.weights.resize(num_bodies);
+    universe.forces.resize(num_bodies);
+    universe.velocities.resize(num_bodies);
+    universe.positions.resize(num_bodies);
+
+    #pragma omp parallel for
+    for(std::int32_t i = 0; i < static_cast<std::int32_t>(num_bodies); i++){
+        universe.weights[i] = weights[i];
+        universe.forces[i] = Vector2d<double>(forces.x[i], forces.y[i]);
+        universe.velocities[i] = Vector2d<double>(velocities.x[i], velocities.y[i]);
+        universe.positions[i] = Vector2d<double>(positions.x[i], positions.y[i]);
+    }
+}
+
+BoundingBox UniverseSoA::get_bounding_box(){
+    double x_min = std::numeric_limits<double>::max();
+    double x_max = std::numeric_limits<double>::lowest();
+    double y_min = std::numeric_limits<double>::max();
+    double y_max = std::numeric_limits<double>::lowest();
+
+    const double* position_x = positions.x.data();
+    const double* position_y = positions.y.data();
+
+    #pragma omp parallel for simd reduction(min: x_min, y_min) reduction(max: x_max, y_max)
+    for(std::int32_t i = 0; i < static_cast<std::int32_t>(num_bodies); i++){
+        x_min = position_x[i] < x_min ? position_x[i] : x_min;
+        x_max = position_x[i] > x_max ? position_x[i] : x_max;
+        y_min = position_y[i] < y_min ? position_y[i] : y_min;
+        y_max = position_y[i] > y_max ? position_y[i] : y_max;
+    }
+
+    return BoundingBox(x_min, x_max, y_min, y_max);
+}
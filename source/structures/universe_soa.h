@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "structures/bounding_box.h"
+#include "structures/universe.h"
+
+// allocator returning memory aligned to a cache line / AVX-512 register
+template <typename T, std::size_t Alignment = 64> class AlignedAllocator{
+public:
+    using value_type = T;
+
+    template <typename U> struct rebind{
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&){}
+
+    T* allocate(std::size_t n){
+        std::size_t bytes = ((n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+        void* memory = std::aligned_alloc(Alignment, bytes == 0 ? Alignment : bytes);
+        if(memory == nullptr){
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* pointer, std::size_t){
+        std::free(pointer);
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+template <typename T> using aligned_vector = std::vector<T, AlignedAllocator<T>>;
+
+// x and y components of a list of vectors in separate contiguous arrays
+class Vector2dArray{
+public:
+    void resize(std::size_t size){
+        x.resize(size);
+        y.resize(size);
+    }
+
+    aligned_vector<double> x;
+    aligned_vector<double> y;
+};
+
+// structure-of-arrays layout of Universe, lets the compiler vectorize the force and integration loops
+class UniverseSoA{
+public:
+    UniverseSoA(){
+        num_bodies = 0;
+        current_simulation_epoch = 0;
+    }
+    explicit UniverseSoA(Universe& universe): UniverseSoA(){
+        load(universe);
+    }
+
+    // convert from / to the array-of-structures layout
+    void load(Universe& universe);
+    void store(Universe& universe);
+
+    BoundingBox get_bounding_box();
+
+    std::uint32_t num_bodies;
+    aligned_vector<double> weights;  // in kg
+    Vector2dArray forces;  // in N
+    Vector2dArray velocities;  // in m/s
+    Vector2dArray positions;  // in m
+    std::uint32_t current_simulation_epoch;
+};
@@ -36,6 +36,14 @@ static void save_universe(std::filesystem::path file_path, Universe& universe){
         universe_file << std::to_string(force[0]) << " " << std::to_string(force[1]) << std::endl;
     }
 
+    // store body ids, optional
+    if(!universe.body_ids.empty()){
+        universe_file << "### Body IDs" << std::endl;
+        for(auto body_id: universe.body_ids){
+            universe_file << body_id << std::endl;
+        }
+    }
+
     universe_file.close();
 }
 
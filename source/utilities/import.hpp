@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -66,6 +67,21 @@ static void load_universe(std::filesystem::path load_universe_path, Universe& un
         universe.forces[i] = Vector2d(std::stod(value_1), std::stod(value_2));
     }
 
-    
+    // unpack body ids, older files have none
+    universe.body_ids.clear();
+    if(getline(universe_file, line) && line == "### Body IDs"){
+        universe.body_ids.resize(num_bodies);
+        for(int i = 0; i < num_bodies; i++){
+            getline(universe_file, line);
+            universe.body_ids[i] = std::stoull(line);
+        }
 
+        // the id -> slot index needs unique ids
+        std::vector<std::uint64_t> sorted_body_ids = universe.body_ids;
+        std::sort(sorted_body_ids.begin(), sorted_body_ids.end());
+        if(std::adjacent_find(sorted_body_ids.begin(), sorted_body_ids.end()) != sorted_body_ids.end()){
+            throw std::invalid_argument("Could not load universe, the body ids are not unique!");
+        }
+    }
+    universe.update_body_slots();
 }
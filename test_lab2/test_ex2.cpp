@@ -4,9 +4,13 @@
 #include <iostream>
 
 #include "structures/universe.h"
+#include "structures/universe_soa.h"
 #include "utilities/import.hpp"
 #include "simulation/naive_parallel_simulation.h"
 #include "simulation/naive_sequential_simulation.h"
+#include "simulation/naive_tiled_simulation.h"
+#include "simulation/integrator.h"
+#include "input_generator/input_generator.h"
 
 #include "utilities.h"
 
@@ -78,3 +82,136 @@ TEST_F(Ex2Test, test_two_b){
 
 
 
+
+TEST_F(Ex2Test, test_two_structure_of_arrays){
+    Universe uni;
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe_after_calculate_forces.txt"};
+    load_universe(tmp, uni);
+
+    // conversion keeps all values
+    UniverseSoA uni_soa(uni);
+    Universe converted_uni;
+    uni_soa.store(converted_uni);
+    ASSERT_EQ(converted_uni.num_bodies, uni.num_bodies);
+    for(int i = 0; i < uni.num_bodies; i++){
+        ASSERT_EQ(converted_uni.weights[i], uni.weights[i]);
+        ASSERT_EQ(converted_uni.positions[i], uni.positions[i]);
+        ASSERT_EQ(converted_uni.velocities[i], uni.velocities[i]);
+        ASSERT_EQ(converted_uni.forces[i], uni.forces[i]);
+    }
+
+    // forces and velocities match the array-of-structures kernels
+    NaiveParallelSimulation::calculate_forces(uni);
+    NaiveParallelSimulation::calculate_velocities(uni);
+    NaiveParallelSimulation::calculate_forces(uni_soa);
+    NaiveParallelSimulation::calculate_velocities(uni_soa);
+    for(int i = 0; i < uni.num_bodies; i++){
+        ASSERT_NEAR(uni_soa.forces.x[i], uni.forces[i][0], std::abs(uni.forces[i][0]) * 1e-9);
+        ASSERT_NEAR(uni_soa.forces.y[i], uni.forces[i][1], std::abs(uni.forces[i][1]) * 1e-9);
+        ASSERT_NEAR(uni_soa.velocities.x[i], uni.velocities[i][0], std::abs(uni.velocities[i][0]) * 1e-9);
+        ASSERT_NEAR(uni_soa.velocities.y[i], uni.velocities[i][1], std::abs(uni.velocities[i][1]) * 1e-9);
+    }
+}
+
+TEST_F(Ex2Test, test_two_force_kernels){
+    auto universe_paths = {
+        std::filesystem::path{"../test_input/test_five_universe.txt"},
+        std::filesystem::path{"../test_input/test_five_universe_after_one_epoch.txt"}
+    };
+    auto kernel_types = {NaiveForceKernelType::automatic, NaiveForceKernelType::scalar, NaiveForceKernelType::avx2, NaiveForceKernelType::avx512};
+
+    for(auto& path : universe_paths){
+        Universe reference_uni;
+        load_universe(path, reference_uni);
+        NaiveParallelSimulation::calculate_forces(reference_uni);
+
+        for(auto kernel_type : kernel_types){
+            if(!naive_force_kernel_available(kernel_type)){
+                // kernel not supported by this cpu
+                ASSERT_THROW((void)get_naive_force_kernel(kernel_type), std::invalid_argument);
+                continue;
+            }
+            NaiveParallelSimulation::force_kernel = kernel_type;
+
+            Universe uni;
+            load_universe(path, uni);
+            NaiveParallelSimulation::calculate_forces_simd(uni);
+            UniverseSoA uni_soa(uni);
+            NaiveParallelSimulation::calculate_forces_simd(uni_soa);
+
+            ASSERT_EQ(uni.num_bodies, reference_uni.num_bodies);
+            for(int i = 0; i < uni.num_bodies; i++){
+                ASSERT_NEAR(uni.forces[i][0], reference_uni.forces[i][0], std::abs(reference_uni.forces[i][0]) * 1e-9) << get_naive_force_kernel_name(kernel_type);
+                ASSERT_NEAR(uni.forces[i][1], reference_uni.forces[i][1], std::abs(reference_uni.forces[i][1]) * 1e-9) << get_naive_force_kernel_name(kernel_type);
+                ASSERT_EQ(uni_soa.forces.x[i], uni.forces[i][0]);
+                ASSERT_EQ(uni_soa.forces.y[i], uni.forces[i][1]);
+            }
+        }
+    }
+    NaiveParallelSimulation::force_kernel = NaiveForceKernelType::automatic;
+}
+
+TEST_F(Ex2Test, test_two_tiled_forces){
+    Universe reference_uni;
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"};
+    load_universe(tmp, reference_uni);
+    NaiveParallelSimulation::calculate_forces(reference_uni);
+
+    // tile sizes with a partial last tile, a single tile and one body per tile
+    for(std::int32_t tile_size : {7, 32, 1000, 1}){
+        NaiveTiledSimulation::tile_size = tile_size;
+        Universe uni;
+        load_universe(tmp, uni);
+        NaiveTiledSimulation::calculate_forces(uni);
+
+        ASSERT_EQ(uni.num_bodies, reference_uni.num_bodies);
+        for(int i = 0; i < uni.num_bodies; i++){
+            ASSERT_NEAR(uni.forces[i][0], reference_uni.forces[i][0], std::abs(reference_uni.forces[i][0]) * 1e-9) << "tile size " << tile_size;
+            ASSERT_NEAR(uni.forces[i][1], reference_uni.forces[i][1], std::abs(reference_uni.forces[i][1]) * 1e-9) << "tile size " << tile_size;
+        }
+    }
+    NaiveTiledSimulation::tile_size = 512;
+}
+
+// largest relative energy error of the earth orbit over 20 years
+static double earth_orbit_energy_error(IntegratorType integrator, double time_step){
+    Universe uni;
+    InputGenerator::create_earth_orbit(uni);
+    Integrator::integrator = integrator;
+    Integrator::time_step = time_step;
+    double initial_energy = Integrator::total_energy(uni);
+    double max_error = 0;
+    std::int32_t steps = static_cast<std::int32_t>(std::round(20 * 12 * epoch_in_seconds / time_step));
+    for(std::int32_t i = 0; i < steps; i++){
+        Integrator::step(uni, [](Universe& u){ NaiveParallelSimulation::calculate_forces(u); });
+        max_error = std::max(max_error, std::abs((Integrator::total_energy(uni) - initial_energy) / initial_energy));
+    }
+    Integrator::integrator = IntegratorType::euler;
+    Integrator::time_step = epoch_in_seconds;
+    return max_error;
+}
+
+TEST_F(Ex2Test, test_two_integrators){
+    // euler with the default time step is the update of calculate_velocities and calculate_positions
+    Universe uni;
+    InputGenerator::create_random_universe(200, uni);
+    Universe reference_uni = uni;
+    NaiveParallelSimulation::calculate_forces(reference_uni);
+    NaiveParallelSimulation::calculate_velocities(reference_uni);
+    NaiveParallelSimulation::calculate_positions(reference_uni);
+    Integrator::step(uni, [](Universe& u){ NaiveParallelSimulation::calculate_forces(u); });
+    for(int i = 0; i < uni.num_bodies; i++){
+        ASSERT_EQ(uni.velocities[i], reference_uni.velocities[i]);
+        ASSERT_EQ(uni.positions[i], reference_uni.positions[i]);
+    }
+
+    // leapfrog with 4 times the step is more accurate than euler, yoshida more accurate than leapfrog with the same step
+    double euler_error = earth_orbit_energy_error(IntegratorType::euler, epoch_in_seconds / 4);
+    double leapfrog_error = earth_orbit_energy_error(IntegratorType::leapfrog, epoch_in_seconds);
+    Integrator::force_evaluations = 0;
+    double yoshida_error = earth_orbit_energy_error(IntegratorType::yoshida4, epoch_in_seconds);
+    ASSERT_LT(leapfrog_error, euler_error);
+    ASSERT_LT(yoshida_error, leapfrog_error);
+    // the last forces of a step are reused by the next one
+    ASSERT_EQ(Integrator::force_evaluations, 3 * 240 + 1);
+}
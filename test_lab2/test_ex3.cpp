@@ -7,6 +7,7 @@
 #include "input_generator/input_generator.h"
 
 #include "quadtree/quadtree.h"
+#include "quadtree/morton.h"
 
 class Ex3Test : public LabTest {};
 
@@ -147,3 +148,179 @@ TEST_F(Ex3Test, test_three_g){
 
 
 
+TEST_F(Ex3Test, test_three_linear_quadtree){
+    // initialize
+    Universe uni;
+    InputGenerator::create_random_universe(1000, uni);
+    BoundingBox BB = uni.get_bounding_box();
+    // construct linear quadtree
+    Quadtree qt(uni, BB, 3);
+    ASSERT_TRUE(qt.is_linear());
+    const LinearQuadtree& tree = qt.linear_quadtree;
+
+    // every body is sorted in exactly once
+    ASSERT_EQ(tree.body_indices.size(), uni.num_bodies);
+    std::set<std::int32_t> sorted_bodies(tree.body_indices.begin(), tree.body_indices.end());
+    ASSERT_EQ(sorted_bodies.size(), uni.num_bodies);
+    for(std::size_t i = 1; i < tree.morton_keys.size(); i++){
+        ASSERT_LE(tree.morton_keys[i-1], tree.morton_keys[i]);
+    }
+
+    double total_mass = 0.0;
+    for(auto weight: uni.weights){
+        total_mass += weight;
+    }
+    ASSERT_NEAR(tree.nodes[0].cumulative_mass, total_mass, total_mass * 1e-12);
+    ASSERT_EQ(qt.root, nullptr);
+
+    for(std::size_t node_index = 0; node_index < tree.nodes.size(); node_index++){
+        const LinearQuadtreeNode& node = tree.nodes[node_index];
+        ASSERT_GT(node.body_count, 0);
+        if(node.is_leaf()){
+            // leaves hold one body unless the keys are identical
+            ASSERT_EQ(node.body_count, 1);
+            ASSERT_EQ(node.body_identifier, tree.body_indices[node.first_body]);
+            BoundingBox leaf_bb = node.bounding_box;
+            ASSERT_TRUE(leaf_bb.contains(uni.positions[node.body_identifier]));
+            continue;
+        }
+        ASSERT_EQ(node.body_identifier, -1);
+        ASSERT_TRUE(node.child_count <= 4);
+        ASSERT_GT(node.first_child, static_cast<std::int32_t>(node_index));
+
+        // children partition the body range of the parent and lie within its bounding box
+        std::int32_t next_body = node.first_body;
+        BoundingBox node_bb = node.bounding_box;
+        for(std::int32_t c = node.first_child; c < node.first_child + node.child_count; c++){
+            const LinearQuadtreeNode& child = tree.nodes[c];
+            ASSERT_EQ(child.first_body, next_body);
+            next_body += child.body_count;
+            ASSERT_TRUE(node_bb.contains(Vector2d<double>(child.bounding_box.x_min, child.bounding_box.y_min)));
+            ASSERT_TRUE(node_bb.contains(Vector2d<double>(child.bounding_box.x_max, child.bounding_box.y_max)));
+        }
+        ASSERT_EQ(next_body, node.first_body + node.body_count);
+    }
+
+    // a body right above the first midpoint is found by a radius query around it
+    Universe boundary_uni;
+    boundary_uni.num_bodies = 3;
+    boundary_uni.weights = {1.0, 1.0, 1.0};
+    boundary_uni.positions = {Vector2d<double>(0.0, 0.0), Vector2d<double>(1.0, 1.0), Vector2d<double>(0.5 + 5e-11, 0.25)};
+    boundary_uni.velocities.assign(3, Vector2d<double>(0.0, 0.0));
+    boundary_uni.forces.assign(3, Vector2d<double>(0.0, 0.0));
+    Quadtree boundary_qt(boundary_uni, boundary_uni.get_bounding_box(), 3);
+    std::vector<std::int32_t> neighbours;
+    boundary_qt.query_radius(boundary_uni, Vector2d<double>(0.5 + 6e-11, 0.25), 2e-11, neighbours);
+    ASSERT_EQ(neighbours, std::vector<std::int32_t>{2});
+}
+
+
+TEST_F(Ex3Test, test_three_node_arena){
+    Universe uni;
+    InputGenerator::create_random_universe(5000, uni);
+    BoundingBox BB = uni.get_bounding_box();
+
+    // the second tree of every mode reuses the blocks released by the first one
+    for(std::int8_t construct_mode : {0, 0, 1, 1, 2, 2, 4, 4, 5, 5, 6, 6}){
+        Quadtree qt(uni, BB, construct_mode);
+        std::vector<std::int32_t> leaf_count(uni.num_bodies, 0);
+        std::vector<QuadtreeNode*> stack = {qt.root};
+        while(!stack.empty()){
+            QuadtreeNode* current = stack.back();
+            stack.pop_back();
+            ASSERT_TRUE(current->children.size() <= 4);
+            if(current->children.empty()){
+                leaf_count[current->body_identifier]++;
+            }
+            for(auto* child : current->children){
+                stack.push_back(child);
+            }
+        }
+        for(std::int32_t count : leaf_count){
+            ASSERT_EQ(count, 1) << "construct mode " << static_cast<int>(construct_mode);
+        }
+    }
+}
+
+TEST_F(Ex3Test, test_three_partitioned_construction){
+    Universe uni;
+    InputGenerator::create_random_universe(5000, uni);
+    BoundingBox BB = uni.get_bounding_box();
+
+    // single pass partitioning builds the same tree as the sequential construction, children in the same order.
+    // the small task cutoff makes construct_mode 5 spawn tasks below the root
+    Quadtree reference_qt(uni, BB, 0);
+    Quadtree::construct_task_cutoff = 64;
+    for(std::int8_t construct_mode : {4, 5}){
+        Quadtree qt(uni, BB, construct_mode);
+        std::vector<std::pair<QuadtreeNode*, QuadtreeNode*>> stack = {{reference_qt.root, qt.root}};
+        while(!stack.empty()){
+            auto [reference, current] = stack.back();
+            stack.pop_back();
+            ASSERT_EQ(current->children.size(), reference->children.size());
+            ASSERT_EQ(current->body_identifier, reference->body_identifier);
+            ASSERT_EQ(current->bounding_box.x_min, reference->bounding_box.x_min);
+            ASSERT_EQ(current->bounding_box.y_max, reference->bounding_box.y_max);
+            for(std::size_t i = 0; i < current->children.size(); i++){
+                stack.emplace_back(reference->children[i], current->children[i]);
+            }
+        }
+    }
+    Quadtree::construct_task_cutoff = 0;
+}
+
+TEST_F(Ex3Test, test_three_parallel_moments){
+    Universe uni;
+    InputGenerator::create_random_universe(5000, uni);
+    BoundingBox BB = uni.get_bounding_box();
+
+    Quadtree reference_qt(uni, BB, 0);
+    reference_qt.calculate_center_of_mass();
+    reference_qt.calculate_cumulative_masses();
+    Quadtree qt(uni, BB, 0);
+    qt.calculate_moments();
+    // construct_mode 6 computes the moments during the construction, tasks below the root
+    Quadtree::construct_task_cutoff = 64;
+    Quadtree fused_qt(uni, BB, 6);
+    Quadtree::construct_task_cutoff = 0;
+
+    // same summation order as the serial recursion
+    for(Quadtree* tree : {&qt, &fused_qt}){
+        std::vector<std::pair<QuadtreeNode*, QuadtreeNode*>> stack = {{reference_qt.root, tree->root}};
+        while(!stack.empty()){
+            auto [reference, current] = stack.back();
+            stack.pop_back();
+            ASSERT_TRUE(current->cumulative_mass_ready && current->center_of_mass_ready);
+            ASSERT_EQ(current->cumulative_mass, reference->cumulative_mass);
+            ASSERT_EQ(current->center_of_mass[0], reference->center_of_mass[0]);
+            ASSERT_EQ(current->center_of_mass[1], reference->center_of_mass[1]);
+            ASSERT_EQ(current->children.size(), reference->children.size());
+            for(std::size_t i = 0; i < current->children.size(); i++){
+                stack.emplace_back(reference->children[i], current->children[i]);
+            }
+        }
+    }
+}
+
+TEST_F(Ex3Test, test_three_morton_reorder){
+    Universe initial_uni;
+    InputGenerator::create_random_universe(5000, initial_uni);
+    initial_uni.assign_body_ids();
+    Universe uni = initial_uni;
+    morton_reorder(uni);
+
+    // every body moved with all of its columns, the keys are ascending afterwards
+    ASSERT_EQ(uni.num_bodies, initial_uni.num_bodies);
+    BoundingBox bb = uni.get_bounding_box();
+    for(std::int32_t i = 0; i < uni.num_bodies; i++){
+        std::uint64_t body_id = uni.body_ids[i];
+        ASSERT_EQ(uni.get_body_slot(body_id), i);
+        ASSERT_EQ(uni.weights[i], initial_uni.weights[body_id]);
+        ASSERT_EQ(uni.positions[i][0], initial_uni.positions[body_id][0]);
+        ASSERT_EQ(uni.positions[i][1], initial_uni.positions[body_id][1]);
+        ASSERT_EQ(uni.velocities[i][0], initial_uni.velocities[body_id][0]);
+        if(i > 0){
+            ASSERT_LE(morton_key(uni.positions[i - 1][0], uni.positions[i - 1][1], bb), morton_key(uni.positions[i][0], uni.positions[i][1], bb));
+        }
+    }
+}
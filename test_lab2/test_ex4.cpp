@@ -1,7 +1,9 @@
 #include "test.h"
 
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
 
 #include "structures/universe.h"
 #include "utilities/import.hpp"
@@ -9,6 +11,14 @@
 #include "quadtree/quadtree.h"
 
 #include "simulation/barnes_hut_simulation.h"
+#include "simulation/barnes_hut_simulation_with_collisions.h"
+#include "simulation/naive_parallel_simulation.h"
+#include "simulation/naive_sequential_simulation.h"
+#include "simulation/block_timestep_simulation.h"
+#include "simulation/integrator.h"
+#include "simulation/fast_multipole_simulation.h"
+#include "input_generator/input_generator.h"
+#include "physics/gravitation.h"
 
 class Ex4Test : public LabTest {};
 
@@ -51,3 +61,391 @@ TEST_F(Ex4Test, test_four_b){
 
 
 
+TEST_F(Ex4Test, test_four_linear_quadtree_forces){
+    Universe uni;
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"};
+    load_universe(tmp, uni);
+
+    Universe reference_uni;
+    load_universe(tmp, reference_uni);
+    NaiveParallelSimulation::calculate_forces(reference_uni);
+
+    Quadtree qt(uni, uni.get_bounding_box(), 3);
+    BarnesHutSimulation::calculate_forces(uni, qt);
+
+    for(int i = 0; i < uni.num_bodies; i++){
+        double reference_norm = reference_uni.forces[i].norm();
+        ASSERT_LT((uni.forces[i] - reference_uni.forces[i]).norm(), reference_norm * 1e-2);
+    }
+}
+
+TEST_F(Ex4Test, test_four_stack_forces){
+    Universe uni;
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"};
+    load_universe(tmp, uni);
+
+    Universe reference_uni;
+    load_universe(tmp, reference_uni);
+
+    Quadtree qt(uni, uni.get_bounding_box(), 2);
+    qt.calculate_center_of_mass();
+    qt.calculate_cumulative_masses();
+
+    // the stack traversal visits the same nodes in the same order as get_relevant_nodes
+    BarnesHutSimulation::force_engine = 0;
+    BarnesHutSimulation::calculate_forces(reference_uni, qt);
+    BarnesHutSimulation::force_engine = 1;
+    BarnesHutSimulation::calculate_forces(uni, qt);
+    BarnesHutSimulation::force_engine = 0;
+
+    for(int i = 0; i < uni.num_bodies; i++){
+        ASSERT_LT((uni.forces[i] - reference_uni.forces[i]).norm(), reference_uni.forces[i].norm() * 1e-9);
+    }
+}
+
+TEST_F(Ex4Test, test_four_quadrupole){
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"};
+    Universe reference_uni;
+    load_universe(tmp, reference_uni);
+    NaiveParallelSimulation::calculate_forces(reference_uni);
+
+    // summed relative error against the naive forces
+    auto force_error = [&](std::int8_t construct_mode, std::int8_t force_engine, std::int8_t multipole_order){
+        Universe uni;
+        load_universe(tmp, uni);
+        Quadtree qt(uni, uni.get_bounding_box(), construct_mode);
+        qt.calculate_center_of_mass();
+        qt.calculate_cumulative_masses();
+
+        BarnesHutSimulation::force_engine = force_engine;
+        BarnesHutSimulation::multipole_order = multipole_order;
+        BarnesHutSimulation::calculate_forces(uni, qt);
+
+        double error = 0.0;
+        for(int i = 0; i < uni.num_bodies; i++){
+            error += (uni.forces[i] - reference_uni.forces[i]).norm() / reference_uni.forces[i].norm();
+        }
+        return error;
+    };
+
+    BarnesHutSimulation::threshold_theta = 0.8;
+    for(std::int8_t force_engine : {0, 1}){
+        ASSERT_LT(force_error(2, force_engine, 2), force_error(2, force_engine, 0));
+    }
+    ASSERT_LT(force_error(3, 0, 2), force_error(3, 0, 0));
+
+    BarnesHutSimulation::threshold_theta = 0.2;
+    BarnesHutSimulation::force_engine = 0;
+    BarnesHutSimulation::multipole_order = 0;
+}
+
+TEST_F(Ex4Test, test_four_bucket_forces){
+    Universe reference_uni;
+    auto tmp = std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"};
+    load_universe(tmp, reference_uni);
+    NaiveParallelSimulation::calculate_forces(reference_uni);
+
+    BarnesHutSimulation::force_engine = 2;
+    for(std::uint32_t bucket_size : {1, 8, 32}){
+        Universe uni;
+        load_universe(tmp, uni);
+        Quadtree qt(uni, uni.get_bounding_box(), 3, bucket_size);
+        BarnesHutSimulation::calculate_forces(uni, qt);
+
+        for(int i = 0; i < uni.num_bodies; i++){
+            double reference_norm = reference_uni.forces[i].norm();
+            ASSERT_LT((uni.forces[i] - reference_uni.forces[i]).norm(), reference_norm * 1e-2) << "bucket size " << bucket_size;
+        }
+    }
+    BarnesHutSimulation::force_engine = 0;
+}
+
+TEST_F(Ex4Test, test_four_bucket_forces_large_theta){
+    // two close pairs, with theta > 1 the root and the pair nodes pass the criterion for their own bodies
+    Universe uni;
+    for(auto position : {Vector2d<double>(0.0, 0.0), Vector2d<double>(1e9, 0.0), Vector2d<double>(1e11, 1e11), Vector2d<double>(1e11 + 1e9, 1e11)}){
+        uni.forces.push_back(Vector2d<double>(0.0, 0.0));
+        uni.velocities.push_back(Vector2d<double>(0.0, 0.0));
+        uni.positions.push_back(position);
+        uni.weights.push_back(1e24);
+    }
+    uni.num_bodies = 4;
+    Quadtree qt(uni, uni.get_bounding_box(), 3, 1);
+
+    for(double theta : {1.5, 3.0}){
+        BarnesHutSimulation::threshold_theta = theta;
+        BarnesHutSimulation::force_engine = 1;
+        BarnesHutSimulation::calculate_forces(uni, qt);
+        std::vector<Vector2d<double>> reference_forces = uni.forces;
+
+        BarnesHutSimulation::force_engine = 2;
+        BarnesHutSimulation::calculate_forces(uni, qt);
+        for(int i = 0; i < uni.num_bodies; i++){
+            ASSERT_LT((uni.forces[i] - reference_forces[i]).norm(), reference_forces[i].norm() * 1e-9) << "theta " << theta;
+        }
+    }
+    BarnesHutSimulation::threshold_theta = 0.2;
+    BarnesHutSimulation::force_engine = 0;
+}
+
+TEST_F(Ex4Test, test_four_incremental_refit){
+    Universe uni;
+    InputGenerator::create_random_universe(3000, uni);
+    std::unique_ptr<Quadtree> qt;
+    BarnesHutSimulation::update_quadtree(uni, qt);
+
+    // drift the bodies, a few of them leave their leaves
+    for(int epoch = 0; epoch < 20; epoch++){
+        NaiveParallelSimulation::calculate_velocities(uni);
+        NaiveParallelSimulation::calculate_positions(uni);
+    }
+    auto refits = BarnesHutSimulation::tree_refits;
+    BarnesHutSimulation::update_quadtree(uni, qt);
+    ASSERT_EQ(BarnesHutSimulation::tree_refits, refits + 1);
+
+    double total_mass = 0.0;
+    Vector2d<double> center_of_mass(0.0, 0.0);
+    for(int i = 0; i < uni.num_bodies; i++){
+        ASSERT_EQ(qt->body_leaves[i]->body_identifier, i);
+        ASSERT_TRUE(qt->body_leaves[i]->bounding_box.contains(uni.positions[i]));
+        total_mass += uni.weights[i];
+        center_of_mass = center_of_mass + uni.positions[i] * uni.weights[i];
+    }
+    center_of_mass = center_of_mass / total_mass;
+    ASSERT_NEAR(qt->root->cumulative_mass, total_mass, total_mass * 1e-12);
+    ASSERT_LT((qt->root->center_of_mass - center_of_mass).norm(), center_of_mass.norm() * 1e-9);
+
+    // forces of the refitted tree against a freshly built tree
+    Universe reference_uni = uni;
+    Quadtree reference_qt(reference_uni, reference_uni.get_bounding_box(), BarnesHutSimulation::construct_mode);
+    reference_qt.calculate_center_of_mass();
+    reference_qt.calculate_cumulative_masses();
+    BarnesHutSimulation::calculate_forces(reference_uni, reference_qt);
+    BarnesHutSimulation::calculate_forces(uni, *qt);
+    double error = 0.0;
+    double norm = 0.0;
+    for(int i = 0; i < uni.num_bodies; i++){
+        error += (uni.forces[i] - reference_uni.forces[i]).norm();
+        norm += reference_uni.forces[i].norm();
+    }
+    ASSERT_LT(error / norm, 1e-3);
+}
+
+TEST_F(Ex4Test, test_four_fast_multipole){
+    Universe reference_uni;
+    InputGenerator::create_random_universe(3000, reference_uni);
+    Universe uni = reference_uni;
+    NaiveSequentialSimulation::calculate_forces(reference_uni);
+
+    // summed force error relative to the summed force
+    auto force_error = [&](std::uint32_t order, std::uint32_t leaf_size){
+        FastMultipoleSimulation::expansion_order = order;
+        Quadtree qt(uni, uni.get_bounding_box(), 3, leaf_size);
+        FastMultipoleSimulation::calculate_forces(uni, qt);
+
+        double error = 0.0;
+        double norm = 0.0;
+        for(int i = 0; i < uni.num_bodies; i++){
+            error += (uni.forces[i] - reference_uni.forces[i]).norm();
+            norm += reference_uni.forces[i].norm();
+        }
+        return error / norm;
+    };
+
+    double error_order_2 = force_error(2, 16);
+    double error_order_6 = force_error(6, 16);
+    ASSERT_LT(error_order_2, 1e-2);
+    ASSERT_LT(error_order_6, 1e-4);
+    ASSERT_LT(error_order_6, error_order_2);
+    // one body per leaf and everything in one leaf (pure direct summation),
+    // without bucket leaves all neighbours interact through expansions at the opening limit
+    ASSERT_LT(force_error(6, 1), 1e-3);
+    ASSERT_LT(force_error(6, 5000), 1e-12);
+
+    FastMultipoleSimulation::expansion_order = 4;
+}
+
+TEST_F(Ex4Test, test_four_block_timesteps){
+    Universe initial_uni;
+    InputGenerator::create_random_universe(2000, initial_uni);
+    // a black hole with a close companion, only the companion needs small steps
+    initial_uni.weights[0] = 8.54e36;
+    initial_uni.positions[1] = initial_uni.positions[0] + Vector2d<double>(1e12, 0);
+    BoundingBox bb(-5, 5, -5, 5);
+    Plotter plotter(bb, "dummy_plot", 100, 100);
+
+    // with a single level the scheme is the kick-drift-kick leapfrog
+    Universe block_uni = initial_uni;
+    Universe leapfrog_uni = initial_uni;
+    BlockTimestepSimulation::max_level = 0;
+    BlockTimestepSimulation::simulate_epochs(plotter, block_uni, 2, false, 1);
+    std::unique_ptr<Quadtree> quadtree;
+    Integrator::integrator = IntegratorType::leapfrog;
+    for(int epoch = 0; epoch < 2; epoch++){
+        Integrator::step(leapfrog_uni, [&](Universe& u){
+            BarnesHutSimulation::update_quadtree(u, quadtree);
+            BarnesHutSimulation::calculate_forces_stack(u, *quadtree, BarnesHutSimulation::threshold_theta);
+        });
+    }
+    Integrator::integrator = IntegratorType::euler;
+    for(int i = 0; i < block_uni.num_bodies; i++){
+        ASSERT_EQ(block_uni.positions[i], leapfrog_uni.positions[i]);
+        ASSERT_EQ(block_uni.velocities[i], leapfrog_uni.velocities[i]);
+    }
+
+    // individual levels need far fewer force evaluations than a global step with the finest level
+    Universe uni = initial_uni;
+    BlockTimestepSimulation::max_level = 8;
+    BlockTimestepSimulation::body_force_evaluations = 0;
+    BlockTimestepSimulation::simulate_epochs(plotter, uni, 1, false, 1);
+    ASSERT_GE(BlockTimestepSimulation::finest_level, 4);
+    ASSERT_LT(BlockTimestepSimulation::body_force_evaluations * 4, uni.num_bodies * (std::uint64_t{1} << BlockTimestepSimulation::finest_level));
+    ASSERT_TRUE(uni.forces_current);
+
+    // the level only depends on the acceleration, a weakly accelerated body keeps the coarsest step
+    ASSERT_EQ(BlockTimestepSimulation::timestep_level(Vector2d<double>(1e20, 0), 1e30, Integrator::time_step), 0);
+    ASSERT_EQ(BlockTimestepSimulation::timestep_level(Vector2d<double>(1e33, 0), 1e30, Integrator::time_step), BlockTimestepSimulation::max_level);
+}
+
+TEST_F(Ex4Test, test_four_fused_epoch){
+    Universe initial_uni;
+    InputGenerator::create_random_universe(2000, initial_uni);
+    BoundingBox bb(-5, 5, -5, 5);
+    Plotter plotter(bb, "dummy_plot", 100, 100);
+
+    // the fused pipeline computes the same epochs as force calculation, kick and drift in separate passes
+    auto expect_same_epochs = [&](const std::function<void(Universe&)>& simulate, const char* name){
+        Universe separate_uni = initial_uni;
+        Universe fused_uni = initial_uni;
+        NaiveParallelSimulation::fused_epoch = false;
+        BarnesHutSimulation::fused_epoch = false;
+        simulate(separate_uni);
+        NaiveParallelSimulation::fused_epoch = true;
+        BarnesHutSimulation::fused_epoch = true;
+        simulate(fused_uni);
+        NaiveParallelSimulation::fused_epoch = false;
+        BarnesHutSimulation::fused_epoch = false;
+
+        ASSERT_EQ(fused_uni.num_bodies, separate_uni.num_bodies) << name;
+        for(int i = 0; i < fused_uni.num_bodies; i++){
+            ASSERT_EQ(fused_uni.positions[i], separate_uni.positions[i]) << name;
+            ASSERT_EQ(fused_uni.velocities[i], separate_uni.velocities[i]) << name;
+        }
+    };
+
+    expect_same_epochs([&](Universe& u){ NaiveParallelSimulation::simulate_epochs(plotter, u, 3, false, 1); }, "naive");
+    NaiveParallelSimulation::use_simd_kernel = true;
+    expect_same_epochs([&](Universe& u){ NaiveParallelSimulation::simulate_epochs(plotter, u, 3, false, 1); }, "naive simd");
+    NaiveParallelSimulation::use_simd_kernel = false;
+
+    for(std::int8_t force_engine = 0; force_engine <= 2; force_engine++){
+        BarnesHutSimulation::force_engine = force_engine;
+        expect_same_epochs([&](Universe& u){ BarnesHutSimulation::simulate_epochs(plotter, u, 3, false, 1); }, "barnes-hut");
+    }
+    BarnesHutSimulation::force_engine = 0;
+    BarnesHutSimulation::construct_mode = 3;
+    expect_same_epochs([&](Universe& u){ BarnesHutSimulation::simulate_epochs(plotter, u, 3, false, 1); }, "linear quadtree");
+    BarnesHutSimulation::construct_mode = 2;
+    BarnesHutSimulation::incremental_tree = true;
+    expect_same_epochs([&](Universe& u){ BarnesHutSimulation::simulate_epochs(plotter, u, 3, false, 1); }, "incremental tree");
+    BarnesHutSimulation::incremental_tree = false;
+    expect_same_epochs([&](Universe& u){ BarnesHutSimulationWithCollisions::simulate_epochs(plotter, u, 3, false, 1); }, "collisions");
+
+    // boxes of bodies with only negative coordinates
+    Universe negative_uni = initial_uni;
+    for(auto& position : negative_uni.positions){
+        position = Vector2d<double>(-std::abs(position[0]) - 1.0, -std::abs(position[1]) - 1.0);
+    }
+    BoundingBox negative_bb = negative_uni.get_bounding_box();
+    ASSERT_LT(negative_bb.x_max, 0.0);
+    ASSERT_LT(negative_bb.y_max, 0.0);
+    std::vector<Vector2d<double>> next_positions(negative_uni.num_bodies);
+    FusedEulerUpdate update(negative_uni, next_positions.data(), 0.0);
+    for(int i = 0; i < negative_uni.num_bodies; i++){
+        update(i, 0.0, 0.0);
+    }
+    BoundingBox fused_bb = update.get_bounding_box();
+    ASSERT_EQ(fused_bb.x_min, negative_bb.x_min);
+    ASSERT_EQ(fused_bb.x_max, negative_bb.x_max);
+    ASSERT_EQ(fused_bb.y_min, negative_bb.y_min);
+    ASSERT_EQ(fused_bb.y_max, negative_bb.y_max);
+}
+
+TEST_F(Ex4Test, test_four_mixed_precision){
+    // accuracy of the float far field against the double bucket traversal on the same tree
+    for(const char* path : {"../test_input_grading/test_five_ppws24_D75C_universe.txt", "../test_input_grading/test_five_ppws24_D75C_universe_after_50_epochs.txt"}){
+        Universe double_uni;
+        load_universe(std::filesystem::path{path}, double_uni);
+        Universe mixed_uni = double_uni;
+        Quadtree qt(double_uni, double_uni.get_bounding_box(), 3, 1);
+        qt.calculate_moments();
+
+        BarnesHutSimulation::force_engine = 2;
+        BarnesHutSimulation::calculate_forces(double_uni, qt);
+        BarnesHutSimulation::force_engine = 3;
+        BarnesHutSimulation::calculate_forces(mixed_uni, qt);
+        BarnesHutSimulation::force_engine = 0;
+
+        double sum_squared_error = 0.0;
+        double max_error = 0.0;
+        for(int i = 0; i < double_uni.num_bodies; i++){
+            double error = (mixed_uni.forces[i] - double_uni.forces[i]).norm() / double_uni.forces[i].norm();
+            sum_squared_error += error * error;
+            max_error = std::max(max_error, error);
+        }
+        double rms_error = std::sqrt(sum_squared_error / double_uni.num_bodies);
+        ASSERT_LT(rms_error, 1e-6);
+        ASSERT_LT(max_error, 1e-5);
+    }
+}
+
+TEST_F(Ex4Test, test_four_softening_fast_inverse_sqrt){
+    Universe exact_uni;
+    load_universe(std::filesystem::path{"../test_input_grading/test_five_ppws24_D75C_universe.txt"}, exact_uni);
+
+    // fast_inverse_sqrt against sqrt and a division in the naive and the bucket kernels
+    auto max_relative_error = [&](const std::function<void(Universe&)>& calculate_forces){
+        Universe uni = exact_uni;
+        calculate_forces(exact_uni);
+        Gravitation::fast_inverse_sqrt = true;
+        calculate_forces(uni);
+        Gravitation::fast_inverse_sqrt = false;
+        double max_error = 0.0;
+        for(int i = 0; i < uni.num_bodies; i++){
+            max_error = std::max(max_error, (uni.forces[i] - exact_uni.forces[i]).norm() / exact_uni.forces[i].norm());
+        }
+        return max_error;
+    };
+    ASSERT_LT(max_relative_error([](Universe& u){ NaiveParallelSimulation::calculate_forces(u); }), 1e-8);
+    NaiveParallelSimulation::use_simd_kernel = true;
+    ASSERT_LT(max_relative_error([](Universe& u){ NaiveParallelSimulation::calculate_forces(u); }), 1e-8);
+    NaiveParallelSimulation::use_simd_kernel = false;
+    BarnesHutSimulation::force_engine = 2;
+    ASSERT_LT(max_relative_error([](Universe& u){
+        Quadtree qt(u, u.get_bounding_box(), 3, 16);
+        qt.calculate_moments();
+        BarnesHutSimulation::calculate_forces(u, qt);
+    }), 1e-8);
+    BarnesHutSimulation::force_engine = 0;
+
+    // Plummer softening: two bodies at distance 1 with softening length 1 feel G * m1 * m2 / 2^(3/2)
+    Universe pair;
+    pair.num_bodies = 2;
+    pair.weights = {1e10, 2e10};
+    pair.positions = {Vector2d<double>(0.0, 0.0), Vector2d<double>(1.0, 0.0)};
+    pair.velocities = {Vector2d<double>(0.0, 0.0), Vector2d<double>(0.0, 0.0)};
+    pair.forces = {Vector2d<double>(0.0, 0.0), Vector2d<double>(0.0, 0.0)};
+    NaiveParallelSimulation::calculate_forces(pair);
+    double newtonian = pair.forces[0][0];
+    ASSERT_DOUBLE_EQ(newtonian, gravitational_constant * 1e10 * 2e10);
+    Gravitation::softening_length = 1.0;
+    NaiveParallelSimulation::calculate_forces(pair);
+    double softened = pair.forces[0][0];
+    ASSERT_DOUBLE_EQ(softened, newtonian / std::pow(2.0, 1.5));
+    ASSERT_DOUBLE_EQ(pair.forces[1][0], -softened);
+    // the fast multipole method sums the pair in its near field
+    Quadtree qt(pair, pair.get_bounding_box(), 3, FastMultipoleSimulation::max_leaf_size);
+    FastMultipoleSimulation::calculate_forces(pair, qt);
+    Gravitation::softening_length = 0.0;
+    ASSERT_DOUBLE_EQ(pair.forces[0][0], softened);
+}
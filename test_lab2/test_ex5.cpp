@@ -1,9 +1,14 @@
 #include "test.h"
 
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <omp.h>
 
 #include "structures/universe.h"
+#include "input_generator/input_generator.h"
+#include "utilities/import.hpp"
+#include "utilities/export.hpp"
 
 #include "simulation/barnes_hut_simulation_with_collisions.h"
 
@@ -81,3 +86,201 @@ TEST_F(Ex5Test, test_five_a){
 
 
 
+
+// random bodies squeezed into a small box, many collisions including chains of bodies
+static void create_dense_universe(std::int32_t num_bodies, Universe& uni){
+    InputGenerator::create_random_universe(num_bodies, uni);
+    for(auto& position : uni.positions){
+        position = position * (3e12 / 9.46e14);
+    }
+}
+
+static void assert_same_universe(Universe& a, Universe& b){
+    ASSERT_EQ(a.num_bodies, b.num_bodies);
+    for(std::int32_t i = 0; i < a.num_bodies; i++){
+        ASSERT_EQ(a.weights[i], b.weights[i]);
+        ASSERT_EQ(a.positions[i][0], b.positions[i][0]);
+        ASSERT_EQ(a.positions[i][1], b.positions[i][1]);
+        ASSERT_EQ(a.velocities[i][0], b.velocities[i][0]);
+        ASSERT_EQ(a.velocities[i][1], b.velocities[i][1]);
+    }
+}
+
+TEST_F(Ex5Test, test_five_grid_collisions){
+    Universe reference_uni;
+    create_dense_universe(3000, reference_uni);
+    Universe uni = reference_uni;
+
+    BarnesHutSimulationWithCollisions::find_collisions(reference_uni);
+    BarnesHutSimulationWithCollisions::find_collisions_grid(uni);
+    ASSERT_LT(reference_uni.num_bodies, 2900);
+    assert_same_universe(uni, reference_uni);
+
+    // a single cell in which all bodies collide with each other
+    Universe cluster_reference_uni;
+    InputGenerator::create_random_universe(2000, cluster_reference_uni);
+    for(auto& position : cluster_reference_uni.positions){
+        position = position * (1e10 / 9.46e14);
+    }
+    Universe cluster_uni = cluster_reference_uni;
+    BarnesHutSimulationWithCollisions::find_collisions(cluster_reference_uni);
+    BarnesHutSimulationWithCollisions::find_collisions_grid(cluster_uni);
+    ASSERT_EQ(cluster_reference_uni.num_bodies, 1);
+    assert_same_universe(cluster_uni, cluster_reference_uni);
+
+    // more than 2^32 cells along y, the colliding pair lies on both sides of the limit
+    Universe far_reference_uni;
+    const double d = BarnesHutSimulationWithCollisions::collision_distance;
+    for(auto position : {Vector2d<double>(0.0, 0.0), Vector2d<double>(1.5 * d, (4294967296.0 - 0.2) * d), Vector2d<double>(1.5 * d, (4294967296.0 + 0.2) * d)}){
+        far_reference_uni.forces.push_back(Vector2d<double>(0.0, 0.0));
+        far_reference_uni.velocities.push_back(Vector2d<double>(0.0, 0.0));
+        far_reference_uni.positions.push_back(position);
+        far_reference_uni.weights.push_back(1e24);
+    }
+    far_reference_uni.num_bodies = 3;
+    Universe far_uni = far_reference_uni;
+    BarnesHutSimulationWithCollisions::find_collisions(far_reference_uni);
+    BarnesHutSimulationWithCollisions::find_collisions_grid(far_uni);
+    ASSERT_EQ(far_reference_uni.num_bodies, 2);
+    assert_same_universe(far_uni, far_reference_uni);
+}
+
+TEST_F(Ex5Test, test_five_quadtree_collisions){
+    Universe reference_uni;
+    create_dense_universe(3000, reference_uni);
+
+    // refitted tree after the bodies moved, like collision engine 2
+    Universe uni = reference_uni;
+    std::unique_ptr<Quadtree> quadtree;
+    BarnesHutSimulation::update_quadtree(uni, quadtree);
+    for(std::int32_t i = 0; i < uni.num_bodies; i += 50){
+        uni.positions[i] = uni.positions[i] * 1.01;
+    }
+    reference_uni.positions = uni.positions;
+    BarnesHutSimulation::update_quadtree(uni, quadtree);
+
+    Universe linear_uni = reference_uni;
+    Quadtree linear_quadtree(linear_uni, linear_uni.get_bounding_box(), 3);
+
+    BarnesHutSimulationWithCollisions::find_collisions(reference_uni);
+    BarnesHutSimulationWithCollisions::find_collisions_quadtree(uni, *quadtree);
+    BarnesHutSimulationWithCollisions::find_collisions_quadtree(linear_uni, linear_quadtree);
+    ASSERT_LT(reference_uni.num_bodies, 2900);
+    assert_same_universe(uni, reference_uni);
+    assert_same_universe(linear_uni, reference_uni);
+}
+
+TEST_F(Ex5Test, test_five_parallel_collisions){
+    Universe reference_uni;
+    create_dense_universe(3000, reference_uni);
+    Universe uni = reference_uni;
+
+    BarnesHutSimulationWithCollisions::find_collisions(reference_uni);
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    BarnesHutSimulationWithCollisions::find_collisions_parallel(uni);
+    omp_set_num_threads(num_threads);
+    ASSERT_LT(reference_uni.num_bodies, 2900);
+    assert_same_universe(uni, reference_uni);
+}
+
+TEST_F(Ex5Test, test_five_preserve_body_order){
+    Universe initial_uni;
+    create_dense_universe(3000, initial_uni);
+    Universe reference_uni = initial_uni;
+    Universe uni = initial_uni;
+
+    BarnesHutSimulationWithCollisions::find_collisions(reference_uni);
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    BarnesHutSimulationWithCollisions::preserve_body_order = true;
+    BarnesHutSimulationWithCollisions::find_collisions_grid(uni);
+    BarnesHutSimulationWithCollisions::preserve_body_order = false;
+    omp_set_num_threads(num_threads);
+
+    // positions are not changed by collisions, the remaining bodies appear in their initial order
+    ASSERT_EQ(uni.num_bodies, reference_uni.num_bodies);
+    ASSERT_EQ(uni.positions.size(), uni.num_bodies);
+    ASSERT_EQ(uni.forces.size(), uni.num_bodies);
+    std::int32_t initial_index = 0;
+    for(std::int32_t i = 0; i < uni.num_bodies; i++){
+        while(initial_index < initial_uni.num_bodies && !(initial_uni.positions[initial_index][0] == uni.positions[i][0] && initial_uni.positions[initial_index][1] == uni.positions[i][1])){
+            initial_index++;
+        }
+        ASSERT_LT(initial_index, initial_uni.num_bodies);
+        initial_index++;
+    }
+
+    // same bodies as in weight order
+    auto by_position = [](Universe& u){
+        std::vector<std::int32_t> order(u.num_bodies);
+        for(std::int32_t i = 0; i < u.num_bodies; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](std::int32_t a, std::int32_t b){
+            return u.positions[a][0] != u.positions[b][0] ? u.positions[a][0] < u.positions[b][0] : u.positions[a][1] < u.positions[b][1];
+        });
+        Universe sorted;
+        sorted.num_bodies = u.num_bodies;
+        for(std::int32_t i : order){
+            sorted.weights.push_back(u.weights[i]);
+            sorted.positions.push_back(u.positions[i]);
+            sorted.velocities.push_back(u.velocities[i]);
+        }
+        return sorted;
+    };
+    Universe sorted_uni = by_position(uni);
+    Universe sorted_reference_uni = by_position(reference_uni);
+    assert_same_universe(sorted_uni, sorted_reference_uni);
+}
+
+TEST_F(Ex5Test, test_five_body_ids){
+    Universe initial_uni;
+    create_dense_universe(3000, initial_uni);
+    initial_uni.assign_body_ids();
+
+    for(bool preserve_body_order : {false, true}){
+        Universe uni = initial_uni;
+        BarnesHutSimulationWithCollisions::preserve_body_order = preserve_body_order;
+        BarnesHutSimulationWithCollisions::find_collisions_grid(uni);
+        BarnesHutSimulationWithCollisions::preserve_body_order = false;
+
+        // the remaining bodies are found through their ids
+        ASSERT_LT(uni.num_bodies, 2900);
+        ASSERT_EQ(uni.body_ids.size(), uni.num_bodies);
+        std::int32_t absorbed = 0;
+        for(std::uint64_t body_id = 0; body_id < initial_uni.num_bodies; body_id++){
+            std::int64_t slot = uni.get_body_slot(body_id);
+            if(slot == -1){
+                absorbed++;
+                continue;
+            }
+            ASSERT_EQ(uni.body_ids[slot], body_id);
+            ASSERT_EQ(uni.positions[slot][0], initial_uni.positions[body_id][0]);
+            ASSERT_EQ(uni.positions[slot][1], initial_uni.positions[body_id][1]);
+        }
+        ASSERT_EQ(absorbed + uni.num_bodies, initial_uni.num_bodies);
+
+        // ids survive saving and loading
+        auto path = std::filesystem::temp_directory_path() / "test_five_body_ids.txt";
+        save_universe(path, uni);
+        Universe loaded_uni;
+        load_universe(path, loaded_uni);
+        std::filesystem::remove(path);
+        ASSERT_EQ(loaded_uni.body_ids, uni.body_ids);
+        ASSERT_EQ(loaded_uni.get_body_slot(uni.body_ids[0]), 0);
+    }
+
+    // arbitrary large ids from a file, duplicates are rejected
+    Universe uni = initial_uni;
+    uni.body_ids[0] = 1000000000000ull;
+    auto path = std::filesystem::temp_directory_path() / "test_five_body_ids.txt";
+    save_universe(path, uni);
+    Universe loaded_uni;
+    load_universe(path, loaded_uni);
+    ASSERT_EQ(loaded_uni.get_body_slot(1000000000000ull), 0);
+    ASSERT_EQ(loaded_uni.get_body_slot(1), 1);
+    ASSERT_EQ(loaded_uni.get_body_slot(0), -1);
+    uni.body_ids[0] = uni.body_ids[1];
+    save_universe(path, uni);
+    ASSERT_THROW(load_universe(path, loaded_uni), std::invalid_argument);
+    std::filesystem::remove(path);
+}